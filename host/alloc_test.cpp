@@ -0,0 +1,417 @@
+#include <array>
+#include <new>
+#include <optional>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "binary_frame.hpp"
+#include "cy22150.hpp"
+#include "cy22150_model.hpp"
+
+// The host has no I2C so the driver runs on the chip model.
+//
+using CY22150 = CY22150Driver<CY22150Model>;
+
+#include "command_dispatcher.hpp"
+#include "command_processor.hpp"
+#include "frequency.hpp"
+#include "json_writer.hpp"
+#include "pico_host.hpp"
+#include "tx_ring.hpp"
+
+// The firmware has no heap worth the name, so nothing between bytes
+// arriving and the reply going out may allocate.  Once the firmware
+// objects are built every allocation aborts the test, and the core
+// dump shows who asked.
+//
+static bool allocation_forbidden = false;
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+/**
+ * @brief  Abort if allocation is forbidden.
+ * @param  what  Allocator that was called.
+ *
+ * @note   Only write() is safe here, stdio may allocate.
+ */
+static void check_allocation(char const* what)
+{
+    if (!allocation_forbidden)
+        return;
+
+    static char const message[] = "alloc_test: allocation from ";
+    ssize_t written = write(STDERR_FILENO, message, sizeof(message) - 1);
+    written = write(STDERR_FILENO, what, strlen(what));
+    written = write(STDERR_FILENO, "\n", 1);
+    (void)written;
+    abort();
+}
+
+extern "C" void* malloc(size_t size)
+{
+    check_allocation("malloc");
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    check_allocation("calloc");
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+    check_allocation("realloc");
+    return __libc_realloc(pointer, size);
+}
+
+void* operator new(size_t size)
+{
+    check_allocation("operator new");
+    void* pointer = __libc_malloc(size ? size : 1);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    check_allocation("aligned operator new");
+    size_t align = static_cast<size_t>(alignment);
+    void* pointer = aligned_alloc(align, ((size + align - 1) / align) * align);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+// The timer and GPIO calls the engines make.  Nothing fires on the
+// host so sweeps stay running, scheduled changes stay queued and the
+// trigger stays armed until a command says otherwise.
+//
+extern "C" {
+
+alarm_id_t add_alarm_at(absolute_time_t, alarm_callback_t, void*, bool)
+{
+    static alarm_id_t next_alarm = 0;
+    return ++next_alarm;
+}
+
+bool cancel_alarm(alarm_id_t)
+{
+    return true;
+}
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data,
+                            repeating_timer_t* out)
+{
+    out->delay_us = delay_us;
+    out->alarm_id = add_alarm_at(0, nullptr, nullptr, false);
+    out->callback = callback;
+    out->user_data = user_data;
+    return true;
+}
+
+bool cancel_repeating_timer(repeating_timer_t*)
+{
+    return true;
+}
+
+void gpio_init(uint)
+{
+}
+
+void gpio_set_dir(uint, bool)
+{
+}
+
+void gpio_set_irq_enabled(uint, uint32_t, bool)
+{
+}
+
+void gpio_set_irq_enabled_with_callback(uint, uint32_t, bool, gpio_irq_callback_t)
+{
+}
+
+void irq_set_priority(uint, uint8_t)
+{
+}
+
+void irq_set_enabled(uint, bool)
+{
+}
+
+}
+
+// Reference clock the firmware gives the chip, half the 25 MHz PIO
+// clock.
+//
+static constexpr millihertz_t REFERENCE = frequency::from_hz(12500000);
+
+// What comes in from the host, one entry per receive.  Between them
+// they cover every command, batches both ways, coalescing, scheduling
+// and the errors the parser and the dispatcher can return.  The long
+// line and the binary frame are built before the test starts.
+//
+static char const* const INPUTS[] = {
+    "{\"command_number\":100,\"frequency\":14074000,\"seq\":1}\n",
+    "{\"command_number\":100,\"frequency\":7040000.5,\"enable_out\":true,\"accept\":true,\"seq\":2}\n",
+    "{\"command_number\":101}\n",
+    "{\"command_number\":104}\n",
+    "{\"command_number\":105,\"frequency\":3500000}\n",
+    "{\"command_number\":106}\n",
+    "{\"command_number\":107,\"hitless\":true}\n",
+    "{\"command_number\":130}\n",
+    "{\"command_number\":132}\n",
+    "[{\"command_number\":100,\"frequency\":5e6},{\"command_number\":104},{\"command_number\":105,\"hitless\":false}]\n",
+    "{\"command_number\":100,\"frequency\":3000000,\"batch\":true}\n{\"command_number\":105}\n",
+    "[{\"command_number\":100,\"frequency\":5e6},{\"command_number\":100,\"frequency\":\"x\"}]\n",
+    "[{\"command_number\":110,\"start\":1000000,\"stop\":2000000,\"step\":1000,\"dwell_us\":100000}]\n",
+    "[{\"command_number\":104},{\"command_number\":104},{\"command_number\":104},{\"command_number\":104},"
+     "{\"command_number\":104},{\"command_number\":104},{\"command_number\":104},{\"command_number\":104},"
+     "{\"command_number\":104},{\"command_number\":104},{\"command_number\":104},{\"command_number\":104},"
+     "{\"command_number\":104},{\"command_number\":104},{\"command_number\":104},{\"command_number\":104},"
+     "{\"command_number\":104},{\"command_number\":104},{\"command_number\":104}]\n",
+    "[]\n",
+    "{\"command_number\":108,\"coalesce\":true}\n",
+    "{\"command_number\":100,\"frequency\":1000000}\n{\"command_number\":100,\"frequency\":2000000}\n"
+     "{\"command_number\":104,\"frequency\":4000000}\n{\"command_number\":101}\n",
+    "{\"command_number\":108,\"coalesce\":false}\n",
+    "{\"command_number\":108}\n",
+    "{\"command_number\":110,\"start\":1000000,\"stop\":2000000,\"step\":1000,\"dwell_us\":100000}\n",
+    "{\"command_number\":110,\"start\":1000000,\"stop\":2000000,\"step\":1000,\"dwell_us\":100000}\n",
+    "{\"command_number\":111}\n",
+    "{\"command_number\":110}\n",
+    "{\"command_number\":120,\"offset\":0,\"frequencies\":[1000000,2000000,3000000,4000000]}\n",
+    "{\"command_number\":121,\"index\":2}\n",
+    "{\"command_number\":121,\"index\":9}\n",
+    "{\"command_number\":121}\n",
+    "{\"command_number\":122,\"gpio\":2,\"rising\":false}\n",
+    "{\"command_number\":120,\"offset\":0,\"frequencies\":[5000000]}\n",
+    "{\"command_number\":123}\n",
+    "{\"command_number\":122}\n",
+    "{\"command_number\":100,\"frequency\":6000000,\"apply_at_us\":999999999999}\n",
+    "{\"command_number\":100,\"frequency\":6500000,\"apply_at_us\":999999999999}\n",
+    "{\"command_number\":131}\n",
+    "{\"command_number\":100,\"frequency\":1}\n",
+    "{\"command_number\":999}\n",
+    "{\"frequency\":1000000}\n",
+    "{\"command_number\":100,\"frequency\":}\n",
+    "{\"command_number\":100,\"unknown\":1}\n",
+    "\n",
+};
+static constexpr size_t INPUT_COUNT = sizeof(INPUTS) / sizeof(INPUTS[0]);
+
+// A line longer than the receiver takes, and a get_frequency frame.
+//
+static char long_line[1200];
+static char binary_command[32];
+static size_t binary_length = 0;
+
+/**
+ * @brief  Build the inputs that can't be written as literals.
+ */
+void build_inputs()
+{
+    memset(long_line, ' ', sizeof(long_line) - 2);
+    memcpy(long_line, "{\"command_number\":101}", 22);
+    long_line[sizeof(long_line) - 2] = '\n';
+    long_line[sizeof(long_line) - 1] = 0;
+
+    uint8_t payload[16];
+    binary_frame::FieldWriter writer(payload, sizeof(payload));
+    writer.write(static_cast<uint16_t>(GET_FREQUENCY));
+    writer.write(static_cast<uint32_t>(0));
+    writer.seal();
+
+    binary_command[0] = 0x00;
+    binary_length = 1 + binary_frame::cobs_encode(payload, writer.size(),
+                                                  reinterpret_cast<uint8_t*>(binary_command + 1));
+    binary_command[binary_length++] = 0x00;
+}
+
+// Tally of what came out of the dispatcher.
+//
+using tally_t = struct
+{
+    size_t commands;
+    size_t acks;
+    size_t errors;
+    size_t batches;
+};
+
+/**
+ * @brief  Reply to a command, much as the firmware does.
+ * @param  tx       Ring the reply is sent through.
+ * @param  command  Command being answered.
+ * @param  dds      Generator the state is read from.
+ * @param  tally    Counts to update.
+ */
+void reply(TxRing& tx, command_t const& command, CY22150& dds, tally_t& tally)
+{
+    JsonWriter reply(tx);
+    reply.field("command_number", command.command_number);
+    if (command.error.has_value())
+    {
+        reply.field("error", error_code::message(command.error.value()));
+        tally.errors++;
+    }
+    else
+    {
+        reply.frequency("frequency", dds.get_frequency())
+             .field    ("enable_out", dds.get_enabled());
+        tally.acks++;
+    }
+    reply.end();
+    tally.commands++;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 1000000;
+    if (count == 0)
+    {
+        fprintf(stderr, "usage: %s [commands]\n", argv[0]);
+        return 1;
+    }
+
+    build_inputs();
+
+    // The firmware's objects, made as it makes them.  The host's
+    // output buffer is grown up front and emptied as it fills so it
+    // never has to grow again.
+    //
+    static TxRing tx;
+    static CY22150 dds(CY22150Model(REFERENCE), REFERENCE);
+    dds.init();
+
+    static CommandProcessor processor(tx);
+    static SweepEngine sweep(dds);
+    static HopTable hops(dds);
+    static TriggerEngine trigger(dds, hops, 0);
+    static Scheduler schedule(dds);
+    static CommandDispatcher dispatcher(dds, sweep, hops, trigger, schedule, processor);
+    static std::array<command_t*, MAX_BATCH_COMMANDS> batch;
+    processor.set_machine_mode(true);
+
+    static constexpr size_t OUTPUT_LIMIT = 1 << 20;
+    pico_host::sent().reserve(2 * OUTPUT_LIMIT);
+    pico_host::sent().clear();
+
+    tally_t tally {};
+    allocation_forbidden = true;
+
+    for (size_t input = 0; tally.commands < count; input++)
+    {
+        size_t which = input % (INPUT_COUNT + 2);
+        if (which == INPUT_COUNT)
+            pico_host::receive(long_line);
+        else if (which == (INPUT_COUNT + 1))
+            pico_host::receive(binary_command, binary_length);
+        else
+            pico_host::receive(INPUTS[which]);
+
+        while (true)
+        {
+            tx.loop();
+            processor.loop();
+            sweep.loop();
+            trigger.loop();
+            schedule.loop();
+            if (!processor.command_is_available())
+                break;
+
+            size_t taken = processor.get_batch(batch);
+            if ((taken == 1) && processor.get_coalescing() && dispatcher.can_coalesce(*batch[0]))
+            {
+                command_t const* next = processor.peek_command();
+                while ((taken < batch.size()) && next && dispatcher.can_coalesce(*next))
+                {
+                    batch[taken++] = processor.take_command();
+                    next = processor.peek_command();
+                }
+            }
+
+            if (taken > 1)
+            {
+                bool rejected = false;
+                for (size_t i = 0; i < taken; i++)
+                {
+                    rejected = rejected || batch[i]->error.has_value();
+                }
+
+                std::optional<error_code_t> error = std::make_optional(error_code_t::BATCH_NOT_APPLIED);
+                if (!rejected)
+                {
+                    error = dispatcher.dispatch_batch(batch.data(), taken);
+                }
+                for (size_t i = 0; i < taken; i++)
+                {
+                    if (error.has_value() && !batch[i]->error.has_value())
+                        batch[i]->error = error;
+                    reply(tx, *batch[i], dds, tally);
+                }
+                tally.batches++;
+                continue;
+            }
+
+            if (!batch[0]->error.has_value())
+            {
+                batch[0]->error = dispatcher.dispatch(*batch[0]);
+            }
+            reply(tx, *batch[0], dds, tally);
+        }
+
+        if (pico_host::sent().size() > OUTPUT_LIMIT)
+            pico_host::sent().clear();
+    }
+
+    allocation_forbidden = false;
+
+    printf("%zu commands, %zu acked, %zu errors, %zu batches, no allocations\n",
+           tally.commands, tally.acks, tally.errors, tally.batches);
+
+    // Every kind of outcome has to have been seen, or the test isn't
+    // covering what it says it does.
+    //
+    if ((tally.acks == 0) || (tally.errors == 0) || (tally.batches == 0) || (tx.dropped() != 0))
+    {
+        fprintf(stderr, "alloc_test: commands didn't run as expected\n");
+        return 1;
+    }
+    return 0;
+}
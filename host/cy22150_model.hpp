@@ -0,0 +1,321 @@
+#pragma once
+
+#include <array>
+#include <optional>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frequency.hpp"
+
+/**
+ * @brief  Register level model of the CY22150, for the host build.
+ *
+ * @note   The model is a bus, so it can sit under a CY22150Driver in
+ *         place of the I2C hardware.  Writes are decoded the way the
+ *         chip decodes them: the first byte sets the register address
+ *         and every byte after it goes to the next register up.  The
+ *         register file is then read back as charge pump, P, Q,
+ *         divider, crosspoint and output enables, from which the VCO
+ *         and output frequencies follow.
+ *
+ * @note   Settings outside the datasheet limits are reported as faults
+ *         rather than refused, since the real chip takes them too.
+ *
+ * @note   The bus traffic is counted so the cost of a commit can be
+ *         measured.  Reset the counts before the commit and read them
+ *         after it.
+ */
+class CY22150Model
+{
+public:
+
+    static const uint8_t ADDRESS = 0x69;
+
+    // Registers the model decodes.
+    //
+    static const uint8_t CLKOE = 0x09;
+    static const uint8_t DIV1  = 0x0C;
+    static const uint8_t XDRV  = 0x12;
+    static const uint8_t REG40 = 0x40;
+    static const uint8_t REG41 = 0x41;
+    static const uint8_t REG42 = 0x42;
+    static const uint8_t REG44 = 0x44;
+    static const uint8_t REG45 = 0x45;
+    static const uint8_t REG46 = 0x46;
+
+    static const size_t CLOCK_COUNT = 6;
+
+    // Settings outside the datasheet limits.
+    //
+    enum fault_t : uint32_t {
+        FAULT_VCO_LOW      = 1u << 0,   // VCO below 100 MHz
+        FAULT_VCO_HIGH     = 1u << 1,   // VCO above 400 MHz
+        FAULT_PFD_LOW      = 1u << 2,   // Phase detector below 250 kHz
+        FAULT_P_RANGE      = 1u << 3,   // P outside 16 - 1023
+        FAULT_DIVIDER      = 1u << 4,   // DIV1N below 4
+        FAULT_CHARGE_PUMP  = 1u << 5,   // Charge pump doesn't suit P
+        FAULT_PLL_MODE     = 1u << 6,   // Top bits of 0x40 not set
+        FAULT_CROSSPOINT   = 1u << 7,   // Enabled clock with a reserved source
+        FAULT_OUTPUT_HIGH  = 1u << 8,   // Enabled clock above 200 MHz
+    };
+
+    // Source of an output clock, from the crosspoint switch.
+    //
+    enum source_t : uint8_t {
+        SOURCE_REF       = 0,
+        SOURCE_DIV1      = 1,
+        SOURCE_DIV1_BY_2 = 2,
+        SOURCE_DIV1_BY_3 = 3,
+        SOURCE_DIV2      = 4,
+        SOURCE_DIV2_BY_2 = 5,
+        SOURCE_DIV2_BY_4 = 6,
+        SOURCE_RESERVED  = 7,
+    };
+
+    // Chip state decoded from the registers.
+    //
+    using chip_state_t = struct {
+        uint8_t charge_pump;
+        uint16_t p;
+        uint16_t q;
+        uint8_t divider;
+        bool divider_from_ref;
+        uint8_t crystal_drive;
+        uint8_t enabled;
+        std::array<source_t, CLOCK_COUNT> sources;
+        millihertz_t vco;
+        uint32_t faults;
+    };
+
+    /**
+     * @brief  Constructor
+     * @param  reference  Reference clock frequency, in mHz.
+     */
+    CY22150Model(millihertz_t reference)
+        :reference_(reference)
+    { };
+
+    /**
+     * @brief  Take a write from the driver.
+     *
+     * @param  address  7 bit address of the device.
+     * @param  data     Register address followed by the values.
+     * @param  length   Number of bytes.
+     *
+     * @return false, as a NAK, if the write isn't for the chip.
+     */
+    auto write(uint8_t address, uint8_t const* data, size_t length) -> bool
+    {
+        if ((address != ADDRESS) || (length == 0))
+            return false;
+
+        transactions_++;
+        bytes_ += length;
+
+        uint8_t reg = data[0];
+        for (size_t i = 1; i < length; i++)
+        {
+            registers_[reg] = data[i];
+            written_[reg] = true;
+            reg++;
+        }
+        return true;
+    }
+
+    /**
+     * @brief  Return the value last written to a register.
+     * @param  reg  Register address.
+     */
+    auto reg(uint8_t reg) const -> uint8_t
+    {
+        return registers_[reg];
+    }
+
+    /**
+     * @brief  Return true if a register has been written.
+     * @param  reg  Register address.
+     */
+    auto written(uint8_t reg) const -> bool
+    {
+        return written_[reg];
+    }
+
+    /**
+     * @brief  Decode the registers into the chip state.
+     */
+    auto state() const -> chip_state_t
+    {
+        chip_state_t state {};
+
+        // PLL.  P is 2 * (PB + 4) + PO and Q is Q + 2.
+        //
+        uint8_t reg40 = registers_[REG40];
+        uint16_t pb = static_cast<uint16_t>(((reg40 & 0x03) << 8) | registers_[REG41]);
+        uint8_t po = registers_[REG42] >> 7;
+        state.charge_pump = (reg40 >> 2) & 0x07;
+        state.p = static_cast<uint16_t>((2 * (pb + 4)) + po);
+        state.q = static_cast<uint16_t>((registers_[REG42] & 0x7F) + 2);
+        state.vco = (reference_ * state.p) / state.q;
+
+        uint8_t div1 = registers_[DIV1];
+        state.divider = div1 & 0x7F;
+        state.divider_from_ref = (div1 & 0x80) != 0;
+        state.crystal_drive = (registers_[XDRV] >> 3) & 0x07;
+        state.enabled = registers_[CLKOE] & 0x3F;
+
+        // Crosspoint.  Three bits per clock, packed high bit first
+        // across 0x44 - 0x46.
+        //
+        uint32_t crosspoint = (static_cast<uint32_t>(registers_[REG44]) << 16) |
+                              (static_cast<uint32_t>(registers_[REG45]) << 8) |
+                               registers_[REG46];
+        for (size_t clock = 0; clock < CLOCK_COUNT; clock++)
+        {
+            state.sources[clock] = static_cast<source_t>((crosspoint >> (21 - 3 * clock)) & 0x07);
+        }
+
+        state.faults = check(state, reg40);
+        return state;
+    }
+
+    /**
+     * @brief  Return the frequency of an output clock.
+     * @param  clock  Clock number, 1 - 6.
+     * @return The frequency in mHz, or nullopt if the clock is off.
+     *
+     * @note   DIV2 isn't used by the driver and its clocks read as
+     *         zero.
+     */
+    auto clock_frequency(size_t clock) const -> std::optional<millihertz_t>
+    {
+        chip_state_t chip = state();
+        if ((clock < 1) || (clock > CLOCK_COUNT) || ((chip.enabled & (1u << (clock - 1))) == 0))
+            return std::nullopt;
+
+        uint64_t post = 0;
+        switch (chip.sources[clock - 1])
+        {
+            case SOURCE_REF:       return reference_;
+            case SOURCE_DIV1:      post = 1; break;
+            case SOURCE_DIV1_BY_2: post = 2; break;
+            case SOURCE_DIV1_BY_3: post = 3; break;
+            default:               return 0;
+        }
+
+        if (chip.divider == 0)
+            return 0;
+
+        // Worked out in one go and rounded to the nearest mHz, the
+        // same as the driver reports it.
+        //
+        uint64_t numer = chip.divider_from_ref ? reference_ : reference_ * chip.p;
+        uint64_t denom = (chip.divider_from_ref ? 1 : chip.q) * chip.divider * post;
+        return (numer + (denom / 2)) / denom;
+    }
+
+    /**
+     * @brief  Return the number of transactions since the counts were
+     *         last reset.
+     */
+    auto transactions() const -> size_t
+    {
+        return transactions_;
+    }
+
+    /**
+     * @brief  Return the number of bytes written since the counts were
+     *         last reset, register addresses included.
+     */
+    auto bytes() const -> size_t
+    {
+        return bytes_;
+    }
+
+    /**
+     * @brief  Reset the transaction and byte counts.
+     */
+    auto reset_counts() -> void
+    {
+        transactions_ = 0;
+        bytes_ = 0;
+    }
+
+private:
+
+    static constexpr millihertz_t VCO_MIN    = frequency::from_hz(100000000);
+    static constexpr millihertz_t VCO_MAX    = frequency::from_hz(400000000);
+    static constexpr millihertz_t PFD_MIN    = frequency::from_hz(250000);
+    static constexpr millihertz_t OUTPUT_MAX = frequency::from_hz(200000000);
+
+    /**
+     * @brief  Check decoded settings against the datasheet.
+     * @param  state  Decoded state.
+     * @param  reg40  Value of register 0x40.
+     * @return Fault bits.
+     */
+    auto check(chip_state_t const& state, uint8_t reg40) const -> uint32_t
+    {
+        uint32_t faults = 0;
+
+        if (state.vco < VCO_MIN)
+            faults |= FAULT_VCO_LOW;
+        if (state.vco > VCO_MAX)
+            faults |= FAULT_VCO_HIGH;
+        if ((reference_ / state.q) < PFD_MIN)
+            faults |= FAULT_PFD_LOW;
+        if ((state.p < 16) || (state.p > 1023))
+            faults |= FAULT_P_RANGE;
+        if ((reg40 & 0xC0) != 0xC0)
+            faults |= FAULT_PLL_MODE;
+
+        // The charge pump setting depends on P.
+        //
+        uint8_t pump = (state.p <  45) ? 0 :
+                       (state.p < 480) ? 1 :
+                       (state.p < 640) ? 2 :
+                       (state.p < 800) ? 3 :
+                        4;
+        if (state.charge_pump != pump)
+            faults |= FAULT_CHARGE_PUMP;
+
+        // Only what's actually driving an output matters from here on.
+        //
+        bool div1_used = false;
+        for (size_t clock = 0; clock < CLOCK_COUNT; clock++)
+        {
+            if ((state.enabled & (1u << clock)) == 0)
+                continue;
+
+            source_t source = state.sources[clock];
+            if (source == SOURCE_RESERVED)
+                faults |= FAULT_CROSSPOINT;
+            if ((source >= SOURCE_DIV1) && (source <= SOURCE_DIV1_BY_3))
+                div1_used = true;
+        }
+
+        if (div1_used)
+        {
+            if (state.divider < 4)
+            {
+                faults |= FAULT_DIVIDER;
+            }
+            else
+            {
+                millihertz_t source = state.divider_from_ref ? reference_ : state.vco;
+                if ((source / state.divider) > OUTPUT_MAX)
+                    faults |= FAULT_OUTPUT_HIGH;
+            }
+        }
+
+        return faults;
+    }
+
+    millihertz_t reference_;
+
+    std::array<uint8_t, 256> registers_ {};
+    std::array<bool, 256> written_ {};
+
+    size_t transactions_ = 0;
+    size_t bytes_ = 0;
+};
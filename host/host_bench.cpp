@@ -0,0 +1,175 @@
+#include <array>
+#include <chrono>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "command_processor.hpp"
+#include "cy22150.hpp"
+#include "cy22150_model.hpp"
+#include "frequency.hpp"
+#include "pico_host.hpp"
+#include "pll_solver.hpp"
+#include "tx_ring.hpp"
+
+// Reference clock the firmware gives the chip, half the 25 MHz PIO
+// clock.
+//
+static constexpr millihertz_t REFERENCE = frequency::from_hz(12500000);
+
+// Span of the output frequencies used by the benchmarks.
+//
+static constexpr millihertz_t LOWEST  = frequency::from_hz(1000000);
+static constexpr millihertz_t HIGHEST = frequency::from_hz(200000000);
+
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * @brief  Return the nanoseconds since a given time.
+ * @param  start  Time to measure from.
+ */
+double elapsed_ns(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+/**
+ * @brief  Return the i'th of a number of frequencies spread evenly
+ *         across the benchmark span.
+ * @param  i      Index of the frequency.
+ * @param  count  Number of frequencies.
+ */
+millihertz_t spread(size_t i, size_t count)
+{
+    return LOWEST + ((HIGHEST - LOWEST) / count) * i;
+}
+
+/**
+ * @brief  Time the PLL solver on its own.
+ * @param  count  Number of frequencies to solve.
+ */
+void bench_solver(size_t count)
+{
+    PllSolver solver(REFERENCE);
+    volatile uint32_t sink = 0;
+
+    auto start = clock_type::now();
+    for (size_t i = 0; i < count; i++)
+    {
+        PllSolver::pll_settings_t pll = solver.solve(spread(i, count));
+        sink = sink + pll.p;
+    }
+    double ns = elapsed_ns(start);
+
+    printf("solver   %8zu solves    %10.1f ns/solve\n", count, ns / count);
+}
+
+/**
+ * @brief  Time the command processor from received bytes to commands
+ *         on the fifo.
+ * @param  count  Number of command lines to parse.
+ */
+void bench_parser(size_t count)
+{
+    static char const* const LINES[] = {
+        "{\"command_number\":100,\"frequency\":14074000}\n",
+        "{\"command_number\":100,\"frequency\":7040000.5,\"enable_out\":true,\"seq\":12}\n",
+        "{\"command_number\":120,\"offset\":0,\"frequencies\":[1000000,2000000,3000000,4000000]}\n",
+        "[{\"command_number\":100,\"frequency\":5e6},{\"command_number\":104}]\n",
+        "{\"command_number\":102}\n",
+    };
+    static const size_t LINE_COUNT = sizeof(LINES) / sizeof(LINES[0]);
+
+    static TxRing tx;
+    static CommandProcessor processor(tx);
+    static std::array<command_t*, MAX_BATCH_COMMANDS> batch;
+    processor.set_machine_mode(true);
+
+    size_t commands = 0;
+    auto start = clock_type::now();
+    for (size_t i = 0; i < count; i++)
+    {
+        pico_host::receive(LINES[i % LINE_COUNT]);
+        processor.loop();
+        while (processor.command_is_available())
+        {
+            commands += processor.get_batch(batch);
+        }
+    }
+    double ns = elapsed_ns(start);
+
+    printf("parser   %8zu lines     %10.1f ns/line  %10.1f ns/command\n",
+           count, ns / count, ns / commands);
+}
+
+/**
+ * @brief  Time commits through the driver and check what reaches the
+ *         chip.
+ * @param  count    Number of commits.
+ * @param  hitless  Use hitless retuning.
+ *
+ * @note   Each commit steps the frequency a little, as a sweep would,
+ *         so the counts show what the shadow registers save.  After
+ *         every commit the chip model has to be fault free and put out
+ *         the frequency the driver reports.
+ */
+void bench_commit(size_t count, bool hitless)
+{
+    CY22150Driver<CY22150Model> dds(CY22150Model(REFERENCE), REFERENCE);
+    dds.init();
+    dds.set_hitless(hitless);
+    dds.set_enabled(true);
+    dds.commit();
+
+    size_t transactions = 0;
+    size_t bytes = 0;
+    size_t faults = 0;
+    size_t mismatches = 0;
+    double ns = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        dds.set_frequency(frequency::from_hz(10000000 + 1000 * (i % 1000)));
+        dds.bus().reset_counts();
+
+        auto start = clock_type::now();
+        dds.commit();
+        ns += elapsed_ns(start);
+
+        transactions += dds.bus().transactions();
+        bytes += dds.bus().bytes();
+        if (dds.bus().state().faults != 0)
+            faults++;
+        if (dds.bus().clock_frequency(2) != dds.get_frequency())
+            mismatches++;
+    }
+
+    printf("commit   %8zu commits   %10.1f ns/commit %6.2f transactions %6.2f bytes"
+           "  %zu faults %zu mismatches  (%s)\n",
+           count, ns / count,
+           static_cast<double>(transactions) / count,
+           static_cast<double>(bytes) / count,
+           faults, mismatches,
+           hitless ? "hitless" : "normal");
+}
+
+/**
+ * @brief  Main routine.
+ *
+ * @note   Takes the number of iterations of each benchmark as its only
+ *         argument.
+ */
+int main(int argc, char** argv)
+{
+    size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 100000;
+    if (count == 0)
+    {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    bench_solver(count);
+    bench_parser(count);
+    bench_commit(count, false);
+    bench_commit(count, true);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Host stand-in for hardware/clocks.h.
+//
+#include <stdint.h>
+
+enum clock_index {
+    clk_sys = 5,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+#ifdef __cplusplus
+}
+#endif
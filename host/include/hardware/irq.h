@@ -0,0 +1,25 @@
+#pragma once
+
+// Host stand-in for hardware/irq.h.  Only the GPIO interrupt is ever
+// named, and it never fires on the host.
+//
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/gpio.h"
+
+#define IO_IRQ_BANK0 13
+
+#define PICO_HIGHEST_IRQ_PRIORITY 0x00
+#define PICO_DEFAULT_IRQ_PRIORITY 0x80
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void irq_set_priority(uint num, uint8_t hardware_priority);
+void irq_set_enabled(uint num, bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+// Host stand-in for hardware/pio.h.  The PIO only makes the reference
+// clock, which the host takes as given.
+//
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/gpio.h"
+
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t* PIO;
+
+typedef struct pio_program {
+    const uint16_t* instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+#define pio0 ((PIO)0)
+#define pio1 ((PIO)1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint pio_add_program(PIO pio, pio_program_t const* program);
+int pio_claim_unused_sm(PIO pio, bool required);
+
+#ifdef __cplusplus
+}
+#endif
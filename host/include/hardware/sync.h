@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in for hardware/sync.h.  The benchmarks are single
+// threaded, so there's nothing to disable.  In the simulator it locks
+// out the threads standing in for interrupts.
+//
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+#ifdef __cplusplus
+}
+#endif
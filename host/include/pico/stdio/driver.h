@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in for pico/stdio/driver.h.  Only the output half of a
+// stdio driver is used by the firmware.
+//
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct stdio_driver stdio_driver_t;
+
+struct stdio_driver
+{
+    void (*out_chars)(const char* buf, int len);
+    void (*out_flush)(void);
+};
+
+#ifdef __cplusplus
+}
+#endif
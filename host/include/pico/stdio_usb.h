@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in for pico/stdio_usb.h.  The USB port is sent() in the
+// host build and the PTY in the simulator.
+//
+#include <stdbool.h>
+
+#include "pico/stdio/driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern stdio_driver_t stdio_usb;
+
+bool stdio_usb_connected(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+// Host stand-in for the parts of pico/stdlib.h used by the firmware.
+// The benchmarks only need the stdio calls, which pico_host.cpp
+// provides.  The simulator provides the rest.
+//
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/gpio.h"
+#include "pico/time.h"
+
+#define PICO_ERROR_TIMEOUT (-1)
+#define PICO_ERROR_GENERIC (-2)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool stdio_init_all(void);
+int stdio_getchar_timeout_us(uint32_t timeout_us);
+void stdio_set_chars_available_callback(void (*fn)(void*), void* param);
+
+bool set_sys_clock_hz(uint32_t freq_hz, bool required);
+
+#ifdef __cplusplus
+}
+#endif
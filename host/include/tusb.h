@@ -0,0 +1,15 @@
+#pragma once
+
+// Host stand-in for the one TinyUSB call the firmware makes.
+//
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t tud_cdc_write_available(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,128 @@
+#include <chrono>
+#include <string>
+
+#include <string.h>
+
+#include "hardware/sync.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "tusb.h"
+
+#include "pico_host.hpp"
+
+namespace
+{
+    // Bytes from the host wait in a fixed ring, as they would in the
+    // USB buffers, so feeding the firmware never allocates.  Bytes
+    // that don't fit are lost.
+    //
+    constexpr size_t RECEIVE_SIZE = 4096;
+    char received[RECEIVE_SIZE];
+    size_t received_head = 0;
+    size_t received_tail = 0;
+    std::string output;
+    size_t output_writes = 0;
+    size_t output_space = 256;
+
+    void (*chars_available)(void*) = nullptr;
+    void* chars_available_param = nullptr;
+
+    auto const boot = std::chrono::steady_clock::now();
+
+    // USB stdio driver.  Every write lands in output straight away.
+    //
+    auto usb_out_chars(const char* buf, int len) -> void
+    {
+        output.append(buf, static_cast<size_t>(len));
+        output_writes++;
+    }
+
+    auto usb_out_flush() -> void
+    {
+    }
+}
+
+namespace pico_host
+{
+    auto receive(char const* data, size_t length) -> void
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            size_t next = (received_head + 1) % RECEIVE_SIZE;
+            if (next == received_tail)
+                break;
+            received[received_head] = data[i];
+            received_head = next;
+        }
+        if (chars_available)
+            chars_available(chars_available_param);
+    }
+
+    auto receive(char const* text) -> void
+    {
+        receive(text, strlen(text));
+    }
+
+    auto sent() -> std::string&
+    {
+        return output;
+    }
+
+    auto writes() -> size_t&
+    {
+        return output_writes;
+    }
+
+    auto write_space() -> size_t&
+    {
+        return output_space;
+    }
+}
+
+extern "C" {
+
+int stdio_getchar_timeout_us(uint32_t)
+{
+    if (received_head == received_tail)
+        return PICO_ERROR_TIMEOUT;
+
+    char character = received[received_tail];
+    received_tail = (received_tail + 1) % RECEIVE_SIZE;
+    return static_cast<unsigned char>(character);
+}
+
+void stdio_set_chars_available_callback(void (*fn)(void*), void* param)
+{
+    chars_available = fn;
+    chars_available_param = param;
+}
+
+stdio_driver_t stdio_usb = { usb_out_chars, usb_out_flush };
+
+bool stdio_usb_connected(void)
+{
+    return true;
+}
+
+uint32_t tud_cdc_write_available(void)
+{
+    return static_cast<uint32_t>(output_space);
+}
+
+uint64_t time_us_64(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - boot).count();
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+    return 0;
+}
+
+void restore_interrupts(uint32_t)
+{
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+
+#include <stddef.h>
+
+/**
+ * @brief  Serial port of the host build.
+ *
+ * @note   Bytes handed to receive() are what stdio_getchar_timeout_us()
+ *         returns, and everything written to the USB stdio driver ends
+ *         up in sent().  The chars-available callback runs from inside
+ *         receive(), the way the SDK would run it from the UART or USB
+ *         interrupt.
+ */
+namespace pico_host
+{
+    /**
+     * @brief  Pretend bytes have arrived from the host.
+     * @param  data    Bytes received.
+     * @param  length  Number of bytes.
+     *
+     * @note   Up to 4 KB can be waiting to be read, beyond that
+     *         bytes are lost.
+     */
+    auto receive(char const* data, size_t length) -> void;
+
+    /**
+     * @brief  Pretend text has arrived from the host.
+     * @param  text  Null terminated text.
+     */
+    auto receive(char const* text) -> void;
+
+    /**
+     * @brief  Return everything sent so far.  Clear it to start again.
+     */
+    auto sent() -> std::string&;
+
+    /**
+     * @brief  Return the number of writes to the USB stdio driver so
+     *         far.  Zero it to start again.
+     */
+    auto writes() -> size_t&;
+
+    /**
+     * @brief  Return the room the USB CDC buffer reports.  256 bytes,
+     *         as the SDK configures it, unless changed.
+     */
+    auto write_space() -> size_t&;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief  Mock bus for the host build.  Records every write instead of
+ *         sending it anywhere.
+ *
+ * @note   Use it as the bus of a CY22150Driver, and reach the recording
+ *         through the driver's bus().  Writes can be made to fail to
+ *         check that the driver retries them.
+ */
+class RecordingBus
+{
+public:
+
+    // A single bus transaction.
+    //
+    using transaction_t = struct {
+        uint8_t address;
+        std::vector<uint8_t> data;
+    };
+
+    /**
+     * @brief  Record a write.
+     *
+     * @param  address  7 bit address of the device.
+     * @param  data     Bytes written.
+     * @param  length   Number of bytes.
+     *
+     * @return false if writes are set to fail.
+     */
+    auto write(uint8_t address, uint8_t const* data, size_t length) -> bool
+    {
+        if (failing_)
+            return false;
+
+        transactions_.push_back({ address, std::vector<uint8_t>(data, data + length) });
+        bytes_ += length;
+        return true;
+    }
+
+    /**
+     * @brief  Make every write fail, or succeed again.
+     * @param  failing  Fail writes if true.
+     */
+    auto set_failing(bool failing) -> void
+    {
+        failing_ = failing;
+    }
+
+    /**
+     * @brief  Return the writes recorded since the last clear().
+     */
+    auto transactions() const -> std::vector<transaction_t> const&
+    {
+        return transactions_;
+    }
+
+    /**
+     * @brief  Return the number of bytes written since the last
+     *         clear(), register addresses included.
+     */
+    auto bytes() const -> size_t
+    {
+        return bytes_;
+    }
+
+    /**
+     * @brief  Forget everything recorded so far.
+     */
+    auto clear() -> void
+    {
+        transactions_.clear();
+        bytes_ = 0;
+    }
+
+private:
+
+    std::vector<transaction_t> transactions_ {};
+    size_t bytes_ = 0;
+    bool failing_ = false;
+};
@@ -0,0 +1,107 @@
+#include <thread>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "pico_sim.hpp"
+
+// The firmware's main(), renamed by the build.
+//
+int firmware_main();
+
+/**
+ * @brief  Wait for the simulator to be stopped, then report and exit.
+ * @param  signals  Signals that stop it.
+ *
+ * @note   The signals are blocked everywhere else, so they're taken
+ *         here and the report is printed outside a signal handler.
+ */
+void wait_for_stop(sigset_t signals)
+{
+    int signal = 0;
+    sigwait(&signals, &signal);
+
+    pico_sim::report(stderr);
+    pico_sim::unlink();
+    fflush(stderr);
+    _exit(0);
+}
+
+/**
+ * @brief  Print the options.
+ * @param  name  Name the simulator was run as.
+ */
+void usage(char const* name)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --link PATH              make PATH a symlink to the USB port\n"
+            "  --usb-frame-us N         USB frame period (1000)\n"
+            "  --usb-frame-bytes N      most bytes each way per frame (1024)\n"
+            "  --no-bus-time            make I2C transfers take no time\n",
+            name);
+}
+
+/**
+ * @brief  Main routine.  Runs the firmware on the host, with its USB
+ *         port on a PTY and the chip model on its I2C bus.
+ *
+ * @note   Stop it with ^C to see what went over the USB port and the
+ *         I2C bus.
+ */
+int main(int argc, char** argv)
+{
+    pico_sim::config_t config { "", 1000, 1024, true };
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = (i + 1) < argc;
+        if ((strcmp(argv[i], "--link") == 0) && has_value)
+        {
+            config.link = argv[++i];
+        }
+        else if ((strcmp(argv[i], "--usb-frame-us") == 0) && has_value)
+        {
+            config.usb_frame_us = strtoul(argv[++i], nullptr, 10);
+        }
+        else if ((strcmp(argv[i], "--usb-frame-bytes") == 0) && has_value)
+        {
+            config.usb_frame_bytes = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--no-bus-time") == 0)
+        {
+            config.bus_time = false;
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((config.usb_frame_us == 0) || (config.usb_frame_bytes == 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Block the stop signals before any thread starts, so only the
+    // waiting thread sees them.
+    //
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    pico_sim::configure(config);
+    std::thread(wait_for_stop, signals).detach();
+
+    return firmware_main();
+}
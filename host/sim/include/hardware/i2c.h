@@ -0,0 +1,27 @@
+#pragma once
+
+// Simulator stand-in for hardware/i2c.h.  There's one controller, with
+// the CY22150 model on it.  Transfers take as long as they would on
+// the wire at the rate given to i2c_init().
+//
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/gpio.h"
+
+typedef struct i2c_inst i2c_inst_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern i2c_inst_t* const i2c0;
+
+uint i2c_init(i2c_inst_t* i2c, uint baudrate);
+int i2c_write_blocking(i2c_inst_t* i2c, uint8_t addr, const uint8_t* src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t* i2c, uint8_t addr, uint8_t* dst, size_t len, bool nostop);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+// Simulator stand-in for the header pioasm makes from
+// pico_cy22150.pio.  The reference clock the program makes is taken
+// as given, so there's nothing to load.
+//
+#include <stddef.h>
+
+#include "hardware/pio.h"
+
+#define osc_out 16
+
+static const pio_program_t pico_cy22150_program = { NULL, 0, -1 };
+
+static inline void pico_cy22150_program_init(PIO pio, uint sm, uint offset, float frequency_hz)
+{
+    (void)pio;
+    (void)sm;
+    (void)offset;
+    (void)frequency_hz;
+}
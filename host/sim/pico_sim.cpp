@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "tusb.h"
+
+#include "cy22150_model.hpp"
+#include "frequency.hpp"
+#include "pico_sim.hpp"
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    auto const boot = clock_type::now();
+
+    pico_sim::config_t config { "", 1000, 1024, true };
+
+    // Held while an interrupt handler runs and while interrupts are
+    // disabled.  The timer thread waits on timer_changed with it.
+    //
+    std::recursive_mutex irq;
+    std::condition_variable_any timer_changed;
+
+    // USB port.  Size of the TinyUSB CDC transmit buffer, as the SDK
+    // configures it.
+    //
+    const size_t CDC_TX_LEN = 256;
+
+    int master = -1;
+    int slave = -1;
+    std::deque<char> received;
+    std::deque<char> transmit;
+    uint64_t received_bytes = 0;
+    uint64_t sent_bytes = 0;
+    void (*chars_available)(void*) = nullptr;
+    void* chars_available_param = nullptr;
+
+    // Alarms and repeating timers.  A repeating timer is an alarm that
+    // points back at its repeating_timer_t.  running is the alarm whose
+    // callback is being run, and running_cancelled is set if that
+    // callback, or anything else, cancels it.
+    //
+    using alarm_t = struct {
+        alarm_id_t id;
+        uint64_t due_us;
+        alarm_callback_t callback;
+        repeating_timer_t* repeating;
+        void* user_data;
+    };
+
+    std::vector<alarm_t> alarms;
+    alarm_id_t next_alarm = 1;
+    alarm_id_t running = 0;
+    bool running_cancelled = false;
+
+    // I2C bus, with the chip on it.  The bus lock keeps the model
+    // consistent for report().
+    //
+    std::mutex bus;
+    CY22150Model chip(frequency::from_hz(12500000));
+    uint i2c_baudrate = 100000;
+
+    /**
+     * @brief  Wait without giving up the CPU, as the SDK's blocking
+     *         I2C calls do.
+     * @param  us  Time to wait, in microseconds.
+     */
+    void spin_us(double us)
+    {
+        auto until = clock_type::now() + std::chrono::duration<double, std::micro>(us);
+        while (clock_type::now() < until)
+        {
+        }
+    }
+
+    /**
+     * @brief  Return how long a transfer takes on the wire.
+     * @param  length  Number of data bytes.
+     *
+     * @note   The address byte and every data byte take nine clocks
+     *         with the acknowledge, and start and stop about one each.
+     */
+    double bus_time_us(size_t length)
+    {
+        if (!config.bus_time)
+            return 0;
+
+        return ((length + 1) * 9 + 2) * 1e6 / i2c_baudrate;
+    }
+
+    /**
+     * @brief  Insert an alarm in the list and wake the timer thread.
+     * @param  alarm  Alarm to add.
+     */
+    void schedule(alarm_t const& alarm)
+    {
+        std::lock_guard<std::recursive_mutex> lock(irq);
+        alarms.push_back(alarm);
+        timer_changed.notify_one();
+    }
+
+    /**
+     * @brief  Run an alarm that has come due, in "interrupt context",
+     *         and put it back if it asks to run again.
+     * @param  alarm  Alarm that is due.  It has already been taken off
+     *                the list.
+     *
+     * @note   Called with the irq lock held.  Rescheduling follows the
+     *         SDK: a negative delay counts from when the alarm was due
+     *         and a positive one from when the callback returned.
+     */
+    void fire(alarm_t alarm)
+    {
+        running = alarm.id;
+        running_cancelled = false;
+
+        int64_t delay_us = 0;
+        if (alarm.repeating)
+        {
+            if (alarm.repeating->callback(alarm.repeating))
+                delay_us = alarm.repeating->delay_us;
+        }
+        else
+        {
+            delay_us = alarm.callback(alarm.id, alarm.user_data);
+        }
+
+        running = 0;
+        if ((delay_us == 0) || running_cancelled)
+            return;
+
+        alarm.due_us = (delay_us < 0) ? alarm.due_us - delay_us : time_us_64() + delay_us;
+        alarms.push_back(alarm);
+    }
+
+    /**
+     * @brief  Timer thread.  Stands in for the timer interrupt.
+     */
+    void timer_thread()
+    {
+        std::unique_lock<std::recursive_mutex> lock(irq);
+        while (true)
+        {
+            auto next = alarms.end();
+            for (auto alarm = alarms.begin(); alarm != alarms.end(); alarm++)
+            {
+                if ((next == alarms.end()) || (alarm->due_us < next->due_us))
+                    next = alarm;
+            }
+
+            if (next == alarms.end())
+            {
+                timer_changed.wait(lock);
+                continue;
+            }
+
+            uint64_t now = time_us_64();
+            if (next->due_us > now)
+            {
+                timer_changed.wait_for(lock, std::chrono::microseconds(next->due_us - now));
+                continue;
+            }
+
+            alarm_t alarm = *next;
+            alarms.erase(next);
+            fire(alarm);
+        }
+    }
+
+    /**
+     * @brief  USB thread.  Stands in for the USB interrupt and the host
+     *         controller polling the CDC endpoints once a frame.
+     */
+    void usb_thread()
+    {
+        std::vector<char> buffer(config.usb_frame_bytes);
+        auto frame = clock_type::now();
+        while (true)
+        {
+            frame += std::chrono::microseconds(config.usb_frame_us);
+            std::this_thread::sleep_until(frame);
+
+            std::lock_guard<std::recursive_mutex> lock(irq);
+
+            ssize_t count = read(master, buffer.data(), buffer.size());
+            if (count > 0)
+            {
+                received.insert(received.end(), buffer.begin(), buffer.begin() + count);
+                received_bytes += count;
+                if (chars_available)
+                    chars_available(chars_available_param);
+            }
+
+            size_t length = std::min(transmit.size(), buffer.size());
+            if (length > 0)
+            {
+                std::copy(transmit.begin(), transmit.begin() + length, buffer.begin());
+                count = write(master, buffer.data(), length);
+                if (count > 0)
+                {
+                    transmit.erase(transmit.begin(), transmit.begin() + count);
+                    sent_bytes += count;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief  Open the PTY that stands in for the USB port.
+     * @return false if it couldn't be opened.
+     *
+     * @note   The slave end is kept open too, so the port stays up
+     *         while clients come and go, and set raw so bytes pass
+     *         through untouched.
+     */
+    bool open_pty()
+    {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+            return false;
+
+        char const* name = ptsname(master);
+        slave = open(name, O_RDWR | O_NOCTTY);
+        if (slave < 0)
+            return false;
+
+        struct termios settings;
+        tcgetattr(slave, &settings);
+        cfmakeraw(&settings);
+        tcsetattr(slave, TCSANOW, &settings);
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+        if (!config.link.empty())
+        {
+            ::unlink(config.link.c_str());
+            if (symlink(name, config.link.c_str()) != 0)
+            {
+                fprintf(stderr, "cy22150_sim: can't link %s: %s\n", config.link.c_str(), strerror(errno));
+                config.link.clear();
+            }
+        }
+
+        fprintf(stderr, "cy22150_sim: USB port is %s\n",
+                config.link.empty() ? name : config.link.c_str());
+        return true;
+    }
+}
+
+namespace pico_sim
+{
+    auto configure(config_t const& settings) -> void
+    {
+        config = settings;
+    }
+
+    auto report(FILE* out) -> void
+    {
+        uint64_t in = 0;
+        uint64_t out_bytes = 0;
+        {
+            std::lock_guard<std::recursive_mutex> lock(irq);
+            in = received_bytes;
+            out_bytes = sent_bytes;
+        }
+
+        std::lock_guard<std::mutex> lock(bus);
+        CY22150Model::chip_state_t state = chip.state();
+        std::optional<millihertz_t> clock = chip.clock_frequency(2);
+
+        fprintf(out, "usb      %llu bytes in  %llu bytes out\n",
+                static_cast<unsigned long long>(in), static_cast<unsigned long long>(out_bytes));
+        fprintf(out, "i2c      %zu transactions  %zu bytes\n", chip.transactions(), chip.bytes());
+        fprintf(out, "cy22150  P %u  Q %u  divider %u  faults 0x%03x  clock 2 %s%.3f Hz\n",
+                state.p, state.q, state.divider, state.faults,
+                clock.has_value() ? "" : "off ",
+                clock.has_value() ? clock.value() / 1000.0 : 0.0);
+    }
+
+    auto unlink() -> void
+    {
+        if (!config.link.empty())
+            ::unlink(config.link.c_str());
+    }
+}
+
+namespace
+{
+    // USB stdio driver.  Whatever doesn't fit in the CDC transmit
+    // buffer is lost.  Bytes leave the buffer once per USB frame, so
+    // there's nothing to flush.
+    //
+    auto usb_out_chars(const char* buf, int len) -> void
+    {
+        std::lock_guard<std::recursive_mutex> lock(irq);
+        size_t length = std::min(static_cast<size_t>(len), CDC_TX_LEN - transmit.size());
+        transmit.insert(transmit.end(), buf, buf + length);
+    }
+
+    auto usb_out_flush() -> void
+    {
+    }
+}
+
+extern "C" {
+
+// stdio, over the PTY.
+//
+bool stdio_init_all(void)
+{
+    if (!open_pty())
+    {
+        fprintf(stderr, "cy22150_sim: can't open a PTY: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    std::thread(usb_thread).detach();
+    std::thread(timer_thread).detach();
+    return true;
+}
+
+int stdio_getchar_timeout_us(uint32_t timeout_us)
+{
+    uint64_t until = time_us_64() + timeout_us;
+    while (true)
+    {
+        {
+            std::lock_guard<std::recursive_mutex> lock(irq);
+            if (!received.empty())
+            {
+                char character = received.front();
+                received.pop_front();
+                return static_cast<unsigned char>(character);
+            }
+        }
+
+        if (time_us_64() >= until)
+            return PICO_ERROR_TIMEOUT;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+void stdio_set_chars_available_callback(void (*fn)(void*), void* param)
+{
+    std::lock_guard<std::recursive_mutex> lock(irq);
+    chars_available = fn;
+    chars_available_param = param;
+}
+
+stdio_driver_t stdio_usb = { usb_out_chars, usb_out_flush };
+
+bool stdio_usb_connected(void)
+{
+    return true;
+}
+
+uint32_t tud_cdc_write_available(void)
+{
+    std::lock_guard<std::recursive_mutex> lock(irq);
+    return static_cast<uint32_t>(CDC_TX_LEN - transmit.size());
+}
+
+// Time, alarms and repeating timers.
+//
+uint64_t time_us_64(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - boot).count();
+}
+
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void* user_data, bool fire_if_past)
+{
+    std::lock_guard<std::recursive_mutex> lock(irq);
+    if ((time <= time_us_64()) && !fire_if_past)
+        return 0;
+
+    alarm_id_t id = next_alarm;
+    next_alarm = (next_alarm == INT32_MAX) ? 1 : next_alarm + 1;
+    schedule({ id, time, callback, nullptr, user_data });
+    return id;
+}
+
+bool cancel_alarm(alarm_id_t alarm_id)
+{
+    std::lock_guard<std::recursive_mutex> lock(irq);
+    if (alarm_id == running)
+        running_cancelled = true;
+
+    for (auto alarm = alarms.begin(); alarm != alarms.end(); alarm++)
+    {
+        if (alarm->id == alarm_id)
+        {
+            alarms.erase(alarm);
+            timer_changed.notify_one();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out)
+{
+    std::lock_guard<std::recursive_mutex> lock(irq);
+    out->delay_us = delay_us;
+    out->callback = callback;
+    out->user_data = user_data;
+    out->alarm_id = next_alarm;
+    next_alarm = (next_alarm == INT32_MAX) ? 1 : next_alarm + 1;
+
+    uint64_t delay = (delay_us < 0) ? -delay_us : delay_us;
+    schedule({ out->alarm_id, time_us_64() + delay, nullptr, out, user_data });
+    return true;
+}
+
+bool cancel_repeating_timer(repeating_timer_t* timer)
+{
+    return cancel_alarm(timer->alarm_id);
+}
+
+// Interrupts.
+//
+uint32_t save_and_disable_interrupts(void)
+{
+    irq.lock();
+    return 0;
+}
+
+void restore_interrupts(uint32_t)
+{
+    irq.unlock();
+}
+
+void irq_set_priority(uint, uint8_t)
+{
+}
+
+void irq_set_enabled(uint, bool)
+{
+}
+
+// I2C, with the chip model on it.
+//
+i2c_inst_t* const i2c0 = reinterpret_cast<i2c_inst_t*>(&chip);
+
+uint i2c_init(i2c_inst_t*, uint baudrate)
+{
+    i2c_baudrate = baudrate;
+    return baudrate;
+}
+
+int i2c_write_blocking(i2c_inst_t*, uint8_t addr, const uint8_t* src, size_t len, bool)
+{
+    if (addr != CY22150Model::ADDRESS)
+    {
+        spin_us(bus_time_us(0));
+        return PICO_ERROR_GENERIC;
+    }
+
+    spin_us(bus_time_us(len));
+    std::lock_guard<std::mutex> lock(bus);
+    chip.write(addr, src, len);
+    return static_cast<int>(len);
+}
+
+int i2c_read_blocking(i2c_inst_t*, uint8_t addr, uint8_t* dst, size_t len, bool)
+{
+    if (addr != CY22150Model::ADDRESS)
+    {
+        spin_us(bus_time_us(0));
+        return PICO_ERROR_GENERIC;
+    }
+
+    spin_us(bus_time_us(len));
+    for (size_t i = 0; i < len; i++)
+    {
+        dst[i] = 0;
+    }
+    return static_cast<int>(len);
+}
+
+// Everything else the firmware sets up has nothing to do here.
+//
+bool set_sys_clock_hz(uint32_t, bool)
+{
+    return true;
+}
+
+uint32_t clock_get_hz(enum clock_index)
+{
+    return 100000000;
+}
+
+void gpio_init(uint)
+{
+}
+
+void gpio_set_dir(uint, bool)
+{
+}
+
+void gpio_set_function(uint, enum gpio_function)
+{
+}
+
+void gpio_pull_up(uint)
+{
+}
+
+void gpio_set_irq_enabled(uint, uint32_t, bool)
+{
+}
+
+void gpio_set_irq_enabled_with_callback(uint, uint32_t, bool, gpio_irq_callback_t)
+{
+}
+
+uint pio_add_program(PIO, pio_program_t const*)
+{
+    return 0;
+}
+
+int pio_claim_unused_sm(PIO, bool)
+{
+    return 0;
+}
+
+}
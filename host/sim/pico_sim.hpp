@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief  The SDK as the firmware sees it in the simulator.
+ *
+ * @note   The USB port is a PTY, which the python client opens like
+ *         the real device.  Bytes cross it once per USB frame, as they
+ *         would over full speed CDC, and no more than fit in a frame.
+ *
+ * @note   Interrupts are threads.  The USB and timer threads hold a
+ *         lock while they run a callback, and disabling interrupts
+ *         takes the same lock, so the firmware's critical sections
+ *         work as they do on the device.
+ *
+ * @note   I2C writes go to a CY22150Model and take as long as they
+ *         would on the wire.
+ */
+namespace pico_sim
+{
+    // How the simulated device behaves.  A named struct, unlike most
+    // in the firmware, since it's passed between translation units.
+    //
+    struct config_t {
+        std::string link;           // Symlink made to the PTY, if not empty
+        uint32_t usb_frame_us;      // USB frame period
+        size_t usb_frame_bytes;     // Most bytes each way per frame
+        bool bus_time;              // Make I2C transfers take time
+    };
+
+    /**
+     * @brief  Set how the device behaves.  Call before the firmware
+     *         starts.
+     * @param  config  Settings.
+     */
+    auto configure(config_t const& config) -> void;
+
+    /**
+     * @brief  Print what crossed the USB port and the I2C bus.
+     * @param  out  Stream to print to.
+     */
+    auto report(FILE* out) -> void;
+
+    /**
+     * @brief  Remove the PTY symlink, if one was made.
+     */
+    auto unlink() -> void;
+}
@@ -0,0 +1,499 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frequency.hpp"
+#include "pll_solver.hpp"
+
+// Reference clock the firmware gives the chip, half the 25 MHz PIO
+// clock.
+//
+static constexpr millihertz_t REFERENCE = frequency::from_hz(12500000);
+
+// Largest Q that keeps the phase detector at 250 kHz or better.
+//
+static const uint16_t Q_LIMIT = static_cast<uint16_t>(
+    std::min<uint64_t>(REFERENCE / PllSolver::PFD_MIN_MILLIHZ, PllSolver::Q_MAX));
+
+// Span of outputs the VCO and divider limits allow.  Targets outside
+// it can only be approximated.
+//
+static constexpr millihertz_t OUTPUT_MIN =
+    (PllSolver::VCO_MIN_MILLIHZ + PllSolver::D_MAX - 1) / PllSolver::D_MAX;
+static constexpr millihertz_t OUTPUT_MAX = PllSolver::VCO_MAX_MILLIHZ / PllSolver::D_MIN;
+
+using clock_type = std::chrono::steady_clock;
+
+// What a solver found for one target.  found is false if it had
+// nothing to offer.
+//
+using result_t = struct {
+    PllSolver::pll_settings_t pll;
+    uint32_t iterations;
+    bool found;
+};
+
+// A solver under test.
+//
+using solver_t = struct {
+    char const* name;
+    result_t (*solve)(millihertz_t frequency);
+};
+
+// One row of the report.
+//
+using row_t = struct {
+    char const* solver;
+    millihertz_t target;
+    result_t result;
+    double solve_ns;
+    double actual_hz;
+    double error_hz;
+    double error_ppm;
+    double excess_ppm;
+    double vco_hz;
+    double vco_margin_hz;
+    bool legal;
+};
+
+/**
+ * @brief  The firmware's solver.
+ * @param  frequency  Target frequency, in mHz.
+ */
+result_t solve_integer(millihertz_t frequency)
+{
+    static PllSolver solver(REFERENCE);
+    PllSolver::pll_settings_t pll = solver.solve(frequency);
+    return { pll, solver.steps(), true };
+}
+
+/**
+ * @brief  The float search the driver used before the integer solver,
+ *         for comparison.
+ * @param  frequency  Target frequency, in mHz.
+ *
+ * @note   Tries every Q and every divider that might keep the VCO in
+ *         range, rounding P to the nearest counter value, and stops
+ *         early on a match within half a hertz.
+ */
+result_t solve_float(millihertz_t frequency)
+{
+    float reference_hz = REFERENCE / 1000.0f;
+    float frequency_hz = frequency / 1000.0f;
+
+    float q_max = static_cast<int>(reference_hz / 250000.0f);
+    if (q_max > 127.0f) { q_max = 127.0f; }
+
+    float d_min = static_cast<int>(1.0f + 100000000.0f / frequency_hz);
+    float d_max = static_cast<int>(1.0f + 400000000.0f / frequency_hz) - 1.0f;
+    if (d_max > 127.0f) { d_max = 127.0f; }
+
+    result_t result { { 0, 0, 0 }, 0, false };
+    float f_track = frequency_hz;
+    for (float q = 2.0f; (q <= q_max) && (f_track > 0.5f); q++)
+    {
+        for (float d = d_max; (d >= d_min) && (f_track > 0.5f); d--)
+        {
+            result.iterations++;
+
+            float p = (frequency_hz / reference_hz) * q * d;
+            p = ((p - static_cast<int>(p)) > 0.5f) ? static_cast<int>(p + 1.0f) : static_cast<int>(p);
+            p = std::min(std::max(p, 16.0f), 1023.0f);
+
+            float f_test = (reference_hz * p) / (q * d);
+            float f_diff = std::fabs(f_test - frequency_hz);
+            if (f_diff < f_track)
+            {
+                f_track = f_diff;
+                result.pll = { static_cast<uint16_t>(p), static_cast<uint16_t>(q), static_cast<uint16_t>(d) };
+                result.found = true;
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief  Exhaustive search over every legal setting, used as the
+ *         reference for the others.
+ * @param  frequency  Target frequency, in mHz.
+ *
+ * @note   For each Q and divider the error only grows moving P away
+ *         from the exact ratio, so the P either side of it are the
+ *         only ones that can win.  Every P, Q and divider within the
+ *         datasheet limits is covered that way.  Errors are compared
+ *         exactly, in 128 bits.
+ */
+result_t solve_oracle(millihertz_t frequency)
+{
+    result_t result { { 0, 0, 0 }, 0, false };
+    unsigned __int128 best_error = 0;
+    unsigned __int128 best_denom = 1;
+
+    for (uint64_t d = PllSolver::D_MIN; d <= PllSolver::D_MAX; d++)
+    {
+        for (uint64_t q = PllSolver::Q_MIN; q <= Q_LIMIT; q++)
+        {
+            uint64_t p_lo = std::max<uint64_t>(PllSolver::P_MIN,
+                (PllSolver::VCO_MIN_MILLIHZ * q + REFERENCE - 1) / REFERENCE);
+            uint64_t p_hi = std::min<uint64_t>(PllSolver::P_MAX,
+                (PllSolver::VCO_MAX_MILLIHZ * q) / REFERENCE);
+            if (p_lo > p_hi)
+                continue;
+
+            uint64_t denom = q * d;
+            uint64_t exact = (frequency * denom) / REFERENCE;
+            for (uint64_t p : { exact, exact + 1 })
+            {
+                p = std::min(std::max(p, p_lo), p_hi);
+                result.iterations++;
+
+                uint64_t actual = REFERENCE * p;
+                uint64_t target = frequency * denom;
+                uint64_t error = (actual > target) ? (actual - target) : (target - actual);
+                if (!result.found ||
+                    (static_cast<unsigned __int128>(error) * best_denom <
+                     best_error * static_cast<unsigned __int128>(denom)))
+                {
+                    result.found = true;
+                    best_error = error;
+                    best_denom = denom;
+                    result.pll = { static_cast<uint16_t>(p), static_cast<uint16_t>(q), static_cast<uint16_t>(d) };
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static const solver_t SOLVERS[] = {
+    { "integer", solve_integer },
+    { "float",   solve_float },
+    { "oracle",  solve_oracle },
+};
+
+/**
+ * @brief  Time a solver on one target.
+ * @param  solver     Solver to run.
+ * @param  frequency  Target frequency, in mHz.
+ * @param  repeat     Number of runs.  The median is returned.
+ * @param  result     Set to what the solver found.
+ * @return Median solve time, in ns.
+ */
+double time_solve(solver_t const& solver, millihertz_t frequency, size_t repeat, result_t& result)
+{
+    std::vector<double> times(repeat);
+    for (size_t i = 0; i < repeat; i++)
+    {
+        auto start = clock_type::now();
+        result = solver.solve(frequency);
+        times[i] = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    }
+
+    std::nth_element(times.begin(), times.begin() + repeat / 2, times.end());
+    return times[repeat / 2];
+}
+
+/**
+ * @brief  Work out the output, error and VCO margin of a solution.
+ * @param  row     Row holding the target and the solution.  The rest
+ *                 is filled in.
+ * @param  oracle  Best error possible for the target, in ppm, or NAN
+ *                 if nothing legal reaches it.
+ */
+void measure(row_t& row, double oracle)
+{
+    double reference_hz = REFERENCE / 1000.0;
+    double target_hz = row.target / 1000.0;
+    PllSolver::pll_settings_t const& pll = row.result.pll;
+
+    if (!row.result.found || (pll.q == 0) || (pll.d == 0))
+    {
+        row.actual_hz = row.error_hz = row.error_ppm = row.excess_ppm = NAN;
+        row.vco_hz = row.vco_margin_hz = NAN;
+        row.legal = false;
+        return;
+    }
+
+    row.vco_hz = (reference_hz * pll.p) / pll.q;
+    row.actual_hz = row.vco_hz / pll.d;
+    row.error_hz = std::fabs(row.actual_hz - target_hz);
+    row.error_ppm = (row.error_hz / target_hz) * 1e6;
+    row.excess_ppm = row.error_ppm - oracle;
+
+    double vco_min_hz = PllSolver::VCO_MIN_MILLIHZ / 1000.0;
+    double vco_max_hz = PllSolver::VCO_MAX_MILLIHZ / 1000.0;
+    row.vco_margin_hz = std::min(row.vco_hz - vco_min_hz, vco_max_hz - row.vco_hz);
+
+    row.legal = (row.vco_margin_hz >= 0) &&
+                (pll.p >= PllSolver::P_MIN) && (pll.p <= PllSolver::P_MAX) &&
+                (pll.q >= PllSolver::Q_MIN) && (pll.q <= Q_LIMIT) &&
+                (pll.d >= PllSolver::D_MIN) && (pll.d <= PllSolver::D_MAX);
+}
+
+/**
+ * @brief  Print the report as CSV, one line per solver and target.
+ * @param  rows  Report rows.
+ */
+void print_csv(std::vector<row_t> const& rows)
+{
+    printf("solver,target_hz,p,q,d,iterations,solve_ns,actual_hz,error_hz,error_ppm,"
+           "excess_ppm,vco_hz,vco_margin_hz,legal\n");
+    for (row_t const& row : rows)
+    {
+        printf("%s,%.3f,%u,%u,%u,%u,%.1f,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f,%d\n",
+               row.solver, row.target / 1000.0,
+               row.result.pll.p, row.result.pll.q, row.result.pll.d,
+               row.result.iterations, row.solve_ns,
+               row.actual_hz, row.error_hz, row.error_ppm, row.excess_ppm,
+               row.vco_hz, row.vco_margin_hz, row.legal ? 1 : 0);
+    }
+}
+
+/**
+ * @brief  Print a number as JSON, with null for NAN.
+ * @param  name    Field name.
+ * @param  value   Value.
+ * @param  format  printf format for the value.
+ */
+void print_json_number(char const* name, double value, char const* format)
+{
+    printf(",\"%s\":", name);
+    if (std::isnan(value))
+        printf("null");
+    else
+        printf(format, value);
+}
+
+/**
+ * @brief  Print the report as JSON, one object per solver and target.
+ * @param  rows  Report rows.
+ */
+void print_json(std::vector<row_t> const& rows)
+{
+    printf("{\"reference_hz\":%.3f,\"rows\":[\n", REFERENCE / 1000.0);
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        row_t const& row = rows[i];
+        printf("{\"solver\":\"%s\",\"target_hz\":%.3f,\"p\":%u,\"q\":%u,\"d\":%u,\"iterations\":%u",
+               row.solver, row.target / 1000.0,
+               row.result.pll.p, row.result.pll.q, row.result.pll.d, row.result.iterations);
+        print_json_number("solve_ns", row.solve_ns, "%.1f");
+        print_json_number("actual_hz", row.actual_hz, "%.6f");
+        print_json_number("error_hz", row.error_hz, "%.6f");
+        print_json_number("error_ppm", row.error_ppm, "%.6f");
+        print_json_number("excess_ppm", row.excess_ppm, "%.6f");
+        print_json_number("vco_hz", row.vco_hz, "%.3f");
+        print_json_number("vco_margin_hz", row.vco_margin_hz, "%.3f");
+        printf(",\"legal\":%s}%s\n", row.legal ? "true" : "false", (i + 1 < rows.size()) ? "," : "");
+    }
+    printf("]}\n");
+}
+
+/**
+ * @brief  Print a summary for each solver.
+ * @param  rows  Report rows.
+ *
+ * @note   Only targets within the legal output span count towards
+ *         the error figures.
+ */
+void print_summary(std::vector<row_t> const& rows)
+{
+    for (solver_t const& solver : SOLVERS)
+    {
+        std::vector<double> times;
+        double worst_ppm = 0;
+        double worst_excess = 0;
+        size_t worse = 0;
+        size_t illegal = 0;
+        uint64_t iterations = 0;
+
+        for (row_t const& row : rows)
+        {
+            if (strcmp(row.solver, solver.name) != 0)
+                continue;
+
+            times.push_back(row.solve_ns);
+            iterations += row.result.iterations;
+            if (!row.legal)
+                illegal++;
+            if ((row.target < OUTPUT_MIN) || (row.target > OUTPUT_MAX) || !row.legal)
+                continue;
+
+            worst_ppm = std::max(worst_ppm, row.error_ppm);
+            worst_excess = std::max(worst_excess, row.excess_ppm);
+            if (row.excess_ppm > 1e-9)
+                worse++;
+        }
+
+        if (times.empty())
+            continue;
+
+        std::sort(times.begin(), times.end());
+        fprintf(stderr,
+                "%-8s %6zu targets  %10.1f ns p50 %10.1f ns p99  %8.1f iterations"
+                "  %10.6f ppm worst  %10.6f ppm worst excess  %zu worse  %zu illegal\n",
+                solver.name, times.size(),
+                times[times.size() / 2], times[(times.size() * 99) / 100],
+                static_cast<double>(iterations) / times.size(),
+                worst_ppm, worst_excess, worse, illegal);
+    }
+}
+
+/**
+ * @brief  Check the firmware's solver against the others.
+ * @param  rows  Report rows, every solver for one target before the
+ *               next target.
+ * @return Number of targets that failed.
+ *
+ * @note   Within the legal output span the integer solver has to find
+ *         legal settings that are as good as the exhaustive search's,
+ *         and no worse than the float search's wherever that found
+ *         legal settings.  Each failure is printed to stderr.
+ */
+size_t check(std::vector<row_t> const& rows)
+{
+    static const size_t SOLVER_COUNT = sizeof(SOLVERS) / sizeof(SOLVERS[0]);
+    static const double TOLERANCE_PPM = 1e-9;
+
+    size_t failures = 0;
+    for (size_t i = 0; (i + SOLVER_COUNT) <= rows.size(); i += SOLVER_COUNT)
+    {
+        row_t const* integer = nullptr;
+        for (size_t j = i; j < (i + SOLVER_COUNT); j++)
+        {
+            if (strcmp(rows[j].solver, "integer") == 0)
+                integer = &rows[j];
+        }
+        if ((integer == nullptr) || (integer->target < OUTPUT_MIN) || (integer->target > OUTPUT_MAX))
+            continue;
+
+        bool failed = !integer->legal || (integer->excess_ppm > TOLERANCE_PPM);
+        for (size_t j = i; j < (i + SOLVER_COUNT); j++)
+        {
+            row_t const& other = rows[j];
+            if ((&other != integer) && other.legal && (integer->error_ppm > (other.error_ppm + TOLERANCE_PPM)))
+            {
+                fprintf(stderr, "%.3f Hz: integer %.6f ppm, %s %.6f ppm\n",
+                        integer->target / 1000.0, integer->error_ppm, other.solver, other.error_ppm);
+                failed = true;
+            }
+        }
+
+        if (failed)
+        {
+            fprintf(stderr, "%.3f Hz: integer p=%u q=%u d=%u %s, %.6f ppm beyond the exhaustive search\n",
+                    integer->target / 1000.0, integer->result.pll.p, integer->result.pll.q,
+                    integer->result.pll.d, integer->legal ? "legal" : "illegal", integer->excess_ppm);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+/**
+ * @brief  Print the options.
+ * @param  name  Name the program was run as.
+ */
+void usage(char const* name)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --from HZ          lowest target (lowest legal output)\n"
+            "  --to HZ            highest target (200000000)\n"
+            "  --per-decade N     targets per decade, spaced evenly on a log scale (100)\n"
+            "  --repeat N         timed runs of each solve, the median is kept (5)\n"
+            "  --json             write JSON instead of CSV\n"
+            "  --check            write no report, and fail if the integer solver loses\n",
+            name);
+}
+
+/**
+ * @brief  Main routine.
+ *
+ * @note   Runs every solver on targets spread across the output range
+ *         and writes one row per solver and target to stdout.  A
+ *         summary for each solver goes to stderr.  With --check the
+ *         rows are checked instead of written, and the exit status
+ *         says whether they passed.
+ */
+int main(int argc, char** argv)
+{
+    double from_hz = OUTPUT_MIN / 1000.0;
+    double to_hz = 200000000.0;
+    double per_decade = 100;
+    size_t repeat = 5;
+    bool json = false;
+    bool check_only = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = (i + 1) < argc;
+        if ((strcmp(argv[i], "--from") == 0) && has_value)
+            from_hz = strtod(argv[++i], nullptr);
+        else if ((strcmp(argv[i], "--to") == 0) && has_value)
+            to_hz = strtod(argv[++i], nullptr);
+        else if ((strcmp(argv[i], "--per-decade") == 0) && has_value)
+            per_decade = strtod(argv[++i], nullptr);
+        else if ((strcmp(argv[i], "--repeat") == 0) && has_value)
+            repeat = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--check") == 0)
+            check_only = true;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((from_hz <= 0) || (to_hz < from_hz) || (per_decade <= 0) || (repeat == 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<row_t> rows;
+    size_t count = static_cast<size_t>(std::log10(to_hz / from_hz) * per_decade) + 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        double target_hz = from_hz * std::pow(10.0, i / per_decade);
+        millihertz_t target = static_cast<millihertz_t>(std::llround(target_hz * 1000.0));
+
+        // The oracle goes first so the others can be held up to it.
+        //
+        result_t best = solve_oracle(target);
+        row_t oracle_row {};
+        oracle_row.target = target;
+        oracle_row.result = best;
+        measure(oracle_row, 0);
+        double oracle_ppm = best.found ? oracle_row.error_ppm : NAN;
+
+        for (solver_t const& solver : SOLVERS)
+        {
+            row_t row {};
+            row.solver = solver.name;
+            row.target = target;
+            row.solve_ns = time_solve(solver, target, repeat, row.result);
+            measure(row, oracle_ppm);
+            rows.push_back(row);
+        }
+    }
+
+    print_summary(rows);
+    if (check_only)
+    {
+        size_t failures = check(rows);
+        fprintf(stderr, "%zu targets failed\n", failures);
+        return (failures == 0) ? 0 : 1;
+    }
+
+    json ? print_json(rows) : print_csv(rows);
+    return 0;
+}
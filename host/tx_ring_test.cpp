@@ -0,0 +1,149 @@
+#include <string>
+
+#include <stdio.h>
+
+#include "frequency.hpp"
+#include "json_writer.hpp"
+#include "pico_host.hpp"
+#include "tx_ring.hpp"
+
+// Set when a check fails.  Every check runs so one failure doesn't
+// hide the next.
+//
+static bool failed = false;
+
+/**
+ * @brief  Report a failed check.
+ * @param  passed  Outcome of the check.
+ * @param  what    What was being checked.
+ */
+void check(bool passed, char const* what)
+{
+    if (passed)
+        return;
+
+    fprintf(stderr, "tx_ring_test: %s\n", what);
+    failed = true;
+}
+
+/**
+ * @brief  Queue a reply the size of a set_frequency acknowledgement.
+ * @param  tx   Ring to queue it on.
+ * @param  seq  Sequence number, so that every reply is different.
+ */
+void queue_reply(TxRing& tx, uint32_t seq)
+{
+    JsonWriter reply(tx);
+    reply.field    ("command_number", 100)
+         .frequency("frequency", frequency::from_hz(14074000 + seq))
+         .field    ("enable_out", true)
+         .field    ("seq", seq);
+    reply.end();
+}
+
+/**
+ * @brief  Return true if the text is whole replies, in order, with
+ *         sequence numbers counting up from zero.
+ * @param  text   Text sent.
+ * @param  count  Number of replies expected.
+ */
+auto in_order(std::string const& text, size_t count) -> bool
+{
+    size_t line = 0;
+    for (size_t seq = 0; seq < count; seq++)
+    {
+        size_t end = text.find('\n', line);
+        if (end == std::string::npos)
+            return false;
+
+        std::string expected = "\"seq\":" + std::to_string(seq) + "}";
+        size_t found = text.find(expected, line);
+        if ((text[line] != '{') || (found == std::string::npos) || (found > end))
+            return false;
+        line = end + 1;
+    }
+    return line == text.size();
+}
+
+/**
+ * @brief  Empty the ring.
+ * @param  tx  Ring to drain.
+ * @return Number of passes of loop() it took.
+ */
+auto drain(TxRing& tx) -> size_t
+{
+    size_t passes = 0;
+    while (tx.space() < TxRing::RING_LEN)
+    {
+        tx.loop();
+        passes++;
+    }
+    return passes;
+}
+
+int main()
+{
+    static TxRing tx;
+
+    // A reply goes out in one write on the pass after it's queued.
+    //
+    pico_host::sent().clear();
+    pico_host::writes() = 0;
+    queue_reply(tx, 0);
+    tx.loop();
+    check(pico_host::writes() == 1, "one reply took more than one write");
+    check(in_order(pico_host::sent(), 1), "one reply wasn't sent whole");
+
+    // Replies left queued go out a CDC buffer's worth per write.
+    //
+    for (uint32_t seq = 0; seq < 8; seq++)
+    {
+        JsonWriter reply(tx);
+        reply.field("command_number", 101).field("seq", seq);
+        reply.end();
+    }
+    size_t queued = TxRing::RING_LEN - tx.space();
+    size_t buffers = (queued + pico_host::write_space() - 1) / pico_host::write_space();
+    pico_host::writes() = 0;
+    check(drain(tx) == buffers, "queued replies took more passes than buffers");
+    check(pico_host::writes() == buffers, "queued replies took more writes than buffers");
+
+    // A write never runs past the room the USB port reports, and none
+    // is made when there's no room at all.
+    //
+    pico_host::write_space() = 0;
+    pico_host::writes() = 0;
+    tx.send("{\"command_number\":104}\r\n");
+    tx.loop();
+    check(pico_host::writes() == 0, "wrote with no room");
+
+    pico_host::write_space() = 10;
+    size_t before = pico_host::sent().size();
+    tx.loop();
+    check(pico_host::writes() == 1, "no write once there was room");
+    check(pico_host::sent().size() - before == 10, "wrote past the room");
+    pico_host::write_space() = 256;
+    drain(tx);
+
+    // Replies running past the end of the ring split into two writes,
+    // and nothing is lost or reordered on the way.
+    //
+    size_t replies = 0;
+    pico_host::sent().clear();
+    pico_host::writes() = 0;
+    while (pico_host::sent().size() < 4 * TxRing::RING_LEN)
+    {
+        queue_reply(tx, static_cast<uint32_t>(replies++));
+        tx.loop();
+    }
+    size_t wraps = pico_host::sent().size() / TxRing::RING_LEN + 1;
+    check(pico_host::writes() <= replies + wraps, "more than one write per reply");
+    check(in_order(pico_host::sent(), replies), "replies were lost or reordered");
+    check(tx.dropped() == 0, "replies were dropped");
+
+    if (failed)
+        return 1;
+
+    printf("%zu replies in %zu writes\n", replies, pico_host::writes());
+    return 0;
+}
@@ -1,15 +1,24 @@
 #include <stdio.h>
-#include <iostream>
 
 #include "pico/stdlib.h"
 #include "hardware/clocks.h"
 #include "hardware/i2c.h"
 #include "hardware/pio.h"
 
+#include "binary_frame.hpp"
+#include "command_dispatcher.hpp"
 #include "command_processor.hpp"
 #include "cy22150.hpp"
+#include "hop_table.hpp"
+#include "scheduler.hpp"
+#include "sweep_engine.hpp"
+#include "trigger_engine.hpp"
+#include "frequency.hpp"
+#include "json_writer.hpp"
+#include "latency_stats.hpp"
 #include "pico_cy22150.pio.h"
 #include "tiny-json.h"
+#include "tx_ring.hpp"
 
 // I2C defines
 // This example will use I2C0 on GPIO8 (SDA) and GPIO9 (SCL) running at 400KHz.
@@ -20,33 +29,449 @@
 #define I2C_SDA     8
 #define I2C_SCL     9
 
+// Room that has to be free in the transmit ring before a command is
+// taken off the fifo.  Enough for the replies to a full batch, so
+// replies are never dropped; the main loop just waits for the ring to
+// drain instead.
+//
+static const size_t REPLY_SPACE = MAX_BATCH_COMMANDS * 256;
+
 /**
- * @brief  Print the error to the stdout in json format.
+ * @brief  Add the sequence number field to a reply, if the command
+ *         had one.
+ * @param  reply  Reply being written.
+ * @param  seq    Sequence number of the command.
+ */
+void show_seq(JsonWriter& reply, std::optional<uint32_t> const& seq)
+{
+    if (seq.has_value())
+    {
+        reply.field("seq", seq.value());
+    }
+}
+
+/**
+ * @brief  Send the error in json format.
+ * @param  tx       Ring the reply is sent through.
  * @param  command  Structure containing the returned error.
  */
-void show_error(command_t command)
+void show_error(TxRing& tx, command_t const& command)
+{
+    JsonWriter reply(tx);
+    reply.field("command_number", command.command_number);
+    show_seq(reply, command.seq);
+    reply.field("error", error_code::message(command.error.value()));
+    reply.end();
+}
+
+/**
+ * @brief  Tell a pipelining client that a command has been taken off
+ *         the fifo, before it's executed.
+ * @param  tx       Ring the reply is sent through.
+ * @param  command  Command about to be executed.
+ */
+void show_accepted(TxRing& tx, command_t const& command)
 {
-    std::cout << 
-        R"({)" << 
-        R"(  "command_number":)" << command.command_number << "," 
-        R"(  "error":)"          << R"(")"  << command.error.value() << R"(")" <<
-        R"(})" << std::endl;
+    JsonWriter reply(tx);
+    reply.field("command_number", command.command_number);
+    show_seq(reply, command.seq);
+    reply.field("accepted", true);
+    reply.end();
+}
+
+/**
+ * @brief  Add the latency histograms to a reply, then reset them.
+ * @param  reply      Reply being written.
+ * @param  processor  Command processor holding the histograms.
+ *
+ * @note   Each interval has a count, the 50th, 90th and 99th
+ *         percentiles and the maximum, in microseconds.
+ */
+void show_latency(JsonWriter& reply, CommandProcessor& processor)
+{
+#if CY22150_LATENCY_STATS
+    for (size_t interval = 0; interval < latency::INTERVAL_COUNT; interval++)
+    {
+        latency::Histogram const& histogram =
+            processor.latency().histogram(static_cast<latency::interval_t>(interval));
+        latency::interval_fields_t const& fields = latency::INTERVAL_FIELDS[interval];
+
+        reply.field(fields.count, histogram.count())
+             .field(fields.p50,   histogram.percentile(500))
+             .field(fields.p90,   histogram.percentile(900))
+             .field(fields.p99,   histogram.percentile(990))
+             .field(fields.max,   histogram.max());
+    }
+    processor.latency().reset();
+#else
+    (void)reply;
+    (void)processor;
+#endif
 }
 
 /**
  * @brief  Acknowledges the given command by pringing the 
  *         current DDS state.
- * @param  command_number   Identifier for command being acked.
+ * @param  tx               Ring the reply is sent through.
+ * @param  command          Command being acked.
  * @param  dds              Current dds from which state is being pulled.
+ * @param  processor        Command processor, for queue statistics.
+ *
+ * @note   The queue statistics are only included in the reply to
+ *         get_state, and the latency histograms in the reply to
+ *         get_latency, to keep the other acks short.
+ */
+void ack_command(TxRing& tx, command_t const& command, CY22150& dds, CommandProcessor& processor)
+{
+    JsonWriter reply(tx);
+    show_seq(reply, command.seq);
+
+    if (command.command_number == GET_STATE)
+    {
+        reply.field("queue_high_water", processor.queue_high_water())
+             .field("queue_overflows",  processor.queue_overflows());
+    }
+
+    if (command.command_number == GET_LATENCY)
+    {
+        show_latency(reply, processor);
+    }
+
+    reply.field    ("command_number", command.command_number)
+         .frequency("frequency",      dds.get_frequency())
+         .field    ("enable_out",     dds.get_enabled())
+         .field    ("hitless",        dds.get_hitless())
+         .field    ("dark_us",        dds.get_dark_window_us())
+         .field    ("commit_us",      dds.get_commit_us())
+         .field    ("device_time_us", time_us_64());
+    reply.end();
+}
+
+/**
+ * @brief  Send a binary reply frame.
+ * @param  tx       Ring the frame is sent through.
+ * @param  payload  Buffer holding the reply fields.
+ * @param  writer   Writer used to fill the buffer.  The CRC is added
+ *                  here.
+ *
+ * @note   The ring passes bytes on raw so stdio doesn't turn 0x0A
+ *         into CR LF.
+ */
+void send_frame(TxRing& tx, uint8_t const* payload, binary_frame::FieldWriter& writer)
+{
+    uint8_t frame[binary_frame::MAX_FRAME_LEN];
+
+    writer.seal();
+    size_t length = binary_frame::cobs_encode(payload, writer.size(), frame);
+
+    tx.begin();
+    tx.put('\0');
+    tx.put(frame, length);
+    tx.put('\0');
+    tx.commit();
+}
+
+// Status byte of a binary reply.
+//
+enum binary_status_t : uint8_t {
+    BINARY_ACK      = 0,
+    BINARY_ERROR    = 1,
+    BINARY_ACCEPTED = 2,
+};
+
+/**
+ * @brief  Start a binary reply.
+ * @param  writer   Writer for the reply.
+ * @param  command  Command being replied to.
+ * @param  status   Kind of reply.
+ *
+ * @note   Every reply starts with the command number, the status and
+ *         the sequence number, which is 0 if the command didn't have
+ *         one.
+ */
+void start_binary_reply(binary_frame::FieldWriter& writer, command_t const& command, binary_status_t status)
+{
+    writer.write(static_cast<uint16_t>(command.command_number));
+    writer.write(static_cast<uint8_t>(status));
+    writer.write(command.seq.value_or(0));
+}
+
+/**
+ * @brief  Send an error as a binary frame.
+ * @param  tx       Ring the reply is sent through.
+ * @param  command  Structure containing the returned error.
+ *
+ * @note   The text of the error follows the header.
+ */
+void show_binary_error(TxRing& tx, command_t const& command)
+{
+    uint8_t payload[binary_frame::MAX_PAYLOAD_LEN];
+    binary_frame::FieldWriter writer(payload, sizeof(payload));
+
+    start_binary_reply(writer, command, BINARY_ERROR);
+    writer.write(error_code::message(command.error.value()));
+    send_frame(tx, payload, writer);
+}
+
+/**
+ * @brief  Tell a pipelining client that a binary command has been
+ *         taken off the fifo, before it's executed.
+ * @param  tx       Ring the reply is sent through.
+ * @param  command  Command about to be executed.
+ */
+void show_binary_accepted(TxRing& tx, command_t const& command)
+{
+    uint8_t payload[binary_frame::MAX_PAYLOAD_LEN];
+    binary_frame::FieldWriter writer(payload, sizeof(payload));
+
+    start_binary_reply(writer, command, BINARY_ACCEPTED);
+    send_frame(tx, payload, writer);
+}
+
+/**
+ * @brief  Add the latency histograms to a binary reply, then reset
+ *         them.
+ * @param  writer     Writer for the reply.
+ * @param  processor  Command processor holding the histograms.
+ *
+ * @note   Five u32 per interval, in the order of show_latency().
+ */
+void write_binary_latency(binary_frame::FieldWriter& writer, CommandProcessor& processor)
+{
+#if CY22150_LATENCY_STATS
+    for (size_t interval = 0; interval < latency::INTERVAL_COUNT; interval++)
+    {
+        latency::Histogram const& histogram =
+            processor.latency().histogram(static_cast<latency::interval_t>(interval));
+
+        writer.write(histogram.count());
+        writer.write(histogram.percentile(500));
+        writer.write(histogram.percentile(900));
+        writer.write(histogram.percentile(990));
+        writer.write(histogram.max());
+    }
+    processor.latency().reset();
+#else
+    (void)writer;
+    (void)processor;
+#endif
+}
+
+/**
+ * @brief  Acknowledge a binary command with a binary frame.
+ * @param  tx               Ring the reply is sent through.
+ * @param  command          Command being acked.
+ * @param  dds              Current dds from which state is being pulled.
+ * @param  processor        Command processor, for queue statistics.
+ *
+ * @note   The header is followed by the same state as the JSON ack,
+ *         with the frequency in mHz.  The reply to get_latency has
+ *         the latency histograms on the end.
+ */
+void ack_binary_command(TxRing& tx, command_t const& command, CY22150& dds, CommandProcessor& processor)
+{
+    uint8_t payload[binary_frame::MAX_PAYLOAD_LEN];
+    binary_frame::FieldWriter writer(payload, sizeof(payload));
+
+    start_binary_reply(writer, command, BINARY_ACK);
+    writer.write(dds.get_frequency());
+    writer.write(dds.get_enabled());
+    writer.write(dds.get_hitless());
+    writer.write(dds.get_dark_window_us());
+    writer.write(dds.get_commit_us());
+    writer.write(time_us_64());
+    writer.write(processor.queue_high_water());
+    writer.write(processor.queue_overflows());
+    if (command.command_number == GET_LATENCY)
+    {
+        write_binary_latency(writer, processor);
+    }
+    send_frame(tx, payload, writer);
+}
+
+/**
+ * @brief  Report an error in the format the command arrived in.
+ * @param  tx       Ring the reply is sent through.
+ * @param  command  Structure containing the returned error.
+ */
+void reply_error(TxRing& tx, command_t const& command)
+{
+    command.binary ? show_binary_error(tx, command) : show_error(tx, command);
+}
+
+/**
+ * @brief  Report that a command has been accepted, if it asked, in the
+ *         format it arrived in.
+ * @param  tx       Ring the reply is sent through.
+ * @param  command  Command about to be executed.
+ */
+void reply_accepted(TxRing& tx, command_t const& command)
+{
+    if (command.accept.value_or(false))
+    {
+        command.binary ? show_binary_accepted(tx, command) : show_accepted(tx, command);
+    }
+}
+
+/**
+ * @brief  Acknowledge a command in the format it arrived in.
+ * @param  tx         Ring the reply is sent through.
+ * @param  command    Command being acked.
+ * @param  dds        Current dds from which state is being pulled.
+ * @param  processor  Command processor, for queue statistics.
+ */
+void reply_ack(TxRing& tx, command_t const& command, CY22150& dds, CommandProcessor& processor)
+{
+    if (command.binary)
+        ack_binary_command(tx, command, dds, processor);
+    else
+        ack_command(tx, command, dds, processor);
+}
+
+/**
+ * @brief  Add an answered command to the latency histograms.
+ * @param  command    Command just replied to.
+ * @param  processor  Command processor holding the histograms.
+ */
+void record_latency(command_t& command, CommandProcessor& processor)
+{
+    command.stamps.mark(latency::ACK_QUEUED);
+    processor.latency().record(command.stamps);
+}
+
+/**
+ * @brief  Pull queued settings commands in behind the one just taken
+ *         off the fifo, if coalescing is on.
+ * @param  batch       Points at the command taken off the fifo.  The
+ *                     commands pulled in are added after it.
+ * @param  processor   Command processor holding the fifo.
+ * @param  dispatcher  Dispatcher that decides what can be coalesced.
+ * @return Number of commands in the batch.
+ *
+ * @note   The commands are run as a batch, so later settings simply
+ *         overwrite earlier ones before the single commit.
  */
-void ack_command(int command_number, CY22150 dds)
+size_t coalesce(std::array<command_t*, MAX_BATCH_COMMANDS>& batch, CommandProcessor& processor,
+                CommandDispatcher& dispatcher)
 {
-    std::cout << 
-        R"({)" << 
-        R"(  "command_number":)" <<  command_number << "," 
-        R"(  "frequency":)"      <<  static_cast<uint32_t>(dds.get_frequency()) << ","
-        R"(  "enable_out":)"     << (dds.get_enabled() ? "true" : "false") <<
-        R"(})" << std::endl;
+    if (!processor.get_coalescing() || !dispatcher.can_coalesce(*batch[0]))
+        return 1;
+
+    size_t count = 1;
+    command_t const* next = processor.peek_command();
+    while ((count < batch.size()) && next && dispatcher.can_coalesce(*next))
+    {
+        batch[count++] = processor.take_command();
+        next = processor.peek_command();
+    }
+    return count;
+}
+
+/**
+ * @brief  Execute a batch of commands and reply to each of them.
+ * @param  tx          Ring the replies are sent through.
+ * @param  commands    Commands in the batch, where they sit on the fifo.
+ * @param  count       Number of commands.
+ * @param  dispatcher  Dispatcher that executes the batch.
+ * @param  dds         Current dds from which state is being pulled.
+ * @param  processor   Command processor, for queue statistics.
+ *
+ * @note   If any command in the batch is bad none of it is applied
+ *         and every command gets an error, its own if it has one.
+ *         Otherwise every command is acked with the final state.
+ */
+void run_batch(TxRing& tx, command_t* const* commands, size_t count, CommandDispatcher& dispatcher,
+               CY22150& dds, CommandProcessor& processor)
+{
+    bool rejected = false;
+    for (size_t i = 0; i < count; i++)
+    {
+        rejected = rejected || commands[i]->error.has_value();
+    }
+
+    std::optional<error_code_t> error = std::make_optional(error_code_t::BATCH_NOT_APPLIED);
+    if (!rejected)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            reply_accepted(tx, *commands[i]);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            commands[i]->stamps.mark(latency::DISPATCHED);
+        }
+        dds.stamps().clear();
+        error = dispatcher.dispatch_batch(commands, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            commands[i]->stamps.merge(dds.stamps());
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (error.has_value())
+        {
+            if (!commands[i]->error.has_value())
+                commands[i]->error = error;
+            reply_error(tx, *commands[i]);
+        }
+        else
+        {
+            reply_ack(tx, *commands[i], dds, processor);
+        }
+        record_latency(*commands[i], processor);
+    }
+}
+
+/**
+ * @brief  Report the progress of a frequency sweep.
+ * @param  tx        Ring the report is sent through.
+ * @param  progress  Progress of the step just taken.
+ */
+void show_sweep_progress(TxRing& tx, SweepEngine::sweep_progress_t const& progress)
+{
+    JsonWriter report(tx);
+    report.field    ("command_number", START_SWEEP)
+          .field    ("sweep_pass",     progress.pass)
+          .field    ("sweep_index",    progress.index)
+          .frequency("frequency",      progress.frequency)
+          .field    ("overruns",       progress.overruns)
+          .field    ("sweep_done",     progress.done);
+    report.end();
+}
+
+/**
+ * @brief  Report GPIO triggered hops.
+ * @param  tx     Ring the report is sent through.
+ * @param  event  Report for the most recent trigger.
+ */
+void show_trigger_event(TxRing& tx, TriggerEngine::trigger_event_t const& event)
+{
+    JsonWriter report(tx);
+    report.field("command_number", ARM_TRIGGER)
+          .field("trigger_count",  event.count)
+          .field("index",          event.index)
+          .field("latency_us",     event.latency_us)
+          .field("max_latency_us", event.max_latency_us)
+          .field("missed",         event.missed);
+    report.end();
+}
+
+/**
+ * @brief  Report a scheduled change that has been applied.
+ * @param  tx     Ring the report is sent through.
+ * @param  event  Report for the change.
+ */
+void show_scheduled_event(TxRing& tx, Scheduler::scheduled_event_t const& event)
+{
+    JsonWriter report(tx);
+    report.field("command_number", event.command_number);
+    show_seq(report, event.seq);
+    report.field("apply_at_us",    event.apply_at_us)
+          .field("applied_us",     event.applied_us)
+          .field("late_us",        event.applied_us - event.apply_at_us);
+    report.end();
 }
 
 /**
@@ -54,11 +479,11 @@ void ack_command(int command_number, CY22150 dds)
  */
 int main()
 {
-    std::vector<command_t> commands {};
-
-    // Initialization.
+    // Initialization.  Everything sent to the host goes through the
+    // transmit ring, which the main loop drains.
     //
     stdio_init_all();
+    static TxRing tx_ring;
 
     // Set system clock to 100 MHz for easy division.
     //
@@ -88,7 +513,7 @@ int main()
     // The rest of the parameters are user defined and program
     // specific.
     //
-    float pio_frequency_hz = 25000000;   // 25 MHz
+    uint32_t pio_frequency_hz = 25000000;   // 25 MHz
     pico_cy22150_program_init(pio, sm, offset, pio_frequency_hz);
 
     // I2C Initialisation. Using it at 100 kHz.
@@ -103,59 +528,112 @@ int main()
     // to read the i2c address.
     //
     uint8_t rxdata;
-    if (i2c_read_blocking(I2C_PORT, CY22150::I2C_ADDRESS, &rxdata, 1, false) < 0)
-        std::cout << "CY22150 chip not found at address " << CY22150::I2C_ADDRESS << std::endl;
-    else
-        std::cout << "CY22150 chip found at address " << CY22150::I2C_ADDRESS << std::endl;
+    char message[48];
+    bool found = (i2c_read_blocking(I2C_PORT, CY22150::I2C_ADDRESS, &rxdata, 1, false) >= 0);
+    snprintf(message, sizeof(message), "CY22150 chip %sfound at address 0x%02x\r\n",
+             found ? "" : "not ", CY22150::I2C_ADDRESS);
+    tx_ring.send(message);
 
     // Create an instance of the frequency generator.
     //
     // Because of the way the clock frequency is generated, the CY22150 
     // clock frequency is 1/2 the pio frequency.
     //
-    CY22150 cy22150(I2C_PORT, pio_frequency_hz / 2);
+    static CY22150 cy22150(I2C_PORT, frequency::from_hz(pio_frequency_hz / 2));
     cy22150.init();
 
-    // Create an instance of the command processor and
-    // start the main loop.
+    // Create an instance of the command processor and dispatcher
+    // and start the main loop.
+    //
+    // Everything here lasts as long as the firmware, and together
+    // it's far more than the 2 KB main stack holds, so it's all
+    // static.
     //
-    CommandProcessor command_processor;
+    static CommandProcessor command_processor(tx_ring);
+    static SweepEngine sweep_engine(cy22150);
+    static HopTable hop_table(cy22150);
+    static TriggerEngine trigger_engine(cy22150, hop_table,
+        (1u << I2C_SDA) | (1u << I2C_SCL) | (1u << osc_out));
+    static Scheduler scheduler(cy22150);
+    static CommandDispatcher command_dispatcher(cy22150, sweep_engine, hop_table, trigger_engine, scheduler,
+                                                command_processor);
+    static std::array<command_t*, MAX_BATCH_COMMANDS> batch;
     while (true)
     {
+        tx_ring.loop();
         command_processor.loop();
 
-        if (command_processor.command_is_available())
+        std::optional<SweepEngine::sweep_progress_t> progress = sweep_engine.loop();
+        if (progress.has_value())
+        {
+            show_sweep_progress(tx_ring, progress.value());
+        }
+
+        std::optional<TriggerEngine::trigger_event_t> trigger = trigger_engine.loop();
+        if (trigger.has_value())
         {
-            // If there is a command available, set the values, then
-            // commit them.
+            show_trigger_event(tx_ring, trigger.value());
+        }
+
+        std::optional<Scheduler::scheduled_event_t> scheduled = scheduler.loop();
+        if (scheduled.has_value())
+        {
+            show_scheduled_event(tx_ring, scheduled.value());
+        }
+
+        if (command_processor.command_is_available() && (tx_ring.space() >= REPLY_SPACE))
+        {
+            // A batch comes off the fifo whole so that all of its
+            // settings go out in a single commit.  So do settings
+            // commands that can be coalesced.
+            //
+            size_t count = command_processor.get_batch(batch);
+            if (count == 1)
+            {
+                count = coalesce(batch, command_processor, command_dispatcher);
+            }
+
+            if (count > 1)
+            {
+                run_batch(tx_ring, batch.data(), count, command_dispatcher, cy22150, command_processor);
+                continue;
+            }
+
+            // Otherwise hand the command to the dispatcher.
             //
             // An error cancels any action so just loop back to the
             // top of the loop.
             //
-            command_t command = command_processor.get_command();
+            command_t& command = *batch[0];
 
             if (command.error.has_value())
             {
-                show_error(command);
+                reply_error(tx_ring, command);
+                record_latency(command, command_processor);
                 continue;
             }
 
-            if (command.frequency_hz.has_value())
-            {
-                float frequency = static_cast<float>(command.frequency_hz.value());
-                cy22150.set_frequency(frequency);
-            }
-            
-            if (command.enable_out.has_value())
+            // A pipelining client can ask to hear that the command
+            // has been accepted before it's executed.
+            //
+            reply_accepted(tx_ring, command);
+
+            command.stamps.mark(latency::DISPATCHED);
+            cy22150.stamps().clear();
+            command.error = command_dispatcher.dispatch(command);
+            command.stamps.merge(cy22150.stamps());
+            if (command.error.has_value())
             {
-                cy22150.set_enabled(command.enable_out.value());
+                reply_error(tx_ring, command);
+                record_latency(command, command_processor);
+                continue;
             }
 
-            cy22150.commit();
-
-            // All went well so acknowledge the command.
+            // All went well so acknowledge the command in the same
+            // format it arrived in.
             //
-            ack_command(command.command_number, cy22150);
+            reply_ack(tx_ring, command, cy22150, command_processor);
+            record_latency(command, command_processor);
         }
     }
 }
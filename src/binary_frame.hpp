@@ -0,0 +1,255 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief  Building blocks for the binary command protocol.
+ *
+ * @note   A frame on the wire is 0x00, the COBS encoded payload, then
+ *         0x00.  The payload is a series of fixed size little-endian
+ *         fields followed by a CRC-16/CCITT-FALSE of those fields,
+ *         low byte first.  COBS guarantees the payload has no 0x00 in
+ *         it so the delimiters can't be mistaken for data.
+ */
+namespace binary_frame
+{
+    // Longest payload, including the CRC, that will be sent or
+    // accepted.
+    //
+    static const size_t MAX_PAYLOAD_LEN = 512;
+
+    // Longest encoded frame, including both delimiters.
+    //
+    static const size_t MAX_FRAME_LEN = MAX_PAYLOAD_LEN + (MAX_PAYLOAD_LEN / 254) + 3;
+
+    static const size_t CRC_LEN = 2;
+
+    /**
+     * @brief  CRC-16/CCITT-FALSE.
+     * @param  data    Bytes to check.
+     * @param  length  Number of bytes.
+     * @return The CRC.
+     */
+    inline auto crc16(uint8_t const* data, size_t length) -> uint16_t
+    {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; i++)
+        {
+            crc ^= static_cast<uint16_t>(data[i]) << 8;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021)
+                                     : static_cast<uint16_t>(crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    /**
+     * @brief  Decode a COBS frame in place.
+     * @param  data    Encoded frame, without the delimiters.
+     * @param  length  Number of encoded bytes.
+     * @return Number of decoded bytes, or zero if the frame is
+     *         malformed.
+     *
+     * @note   The decoded data is never longer than the encoded data
+     *         and is always written behind the read position, so the
+     *         same buffer can be used for both.
+     */
+    inline auto cobs_decode(uint8_t* data, size_t length) -> size_t
+    {
+        size_t read = 0;
+        size_t write = 0;
+        while (read < length)
+        {
+            uint8_t code = data[read++];
+            if (code == 0x00)
+                return 0;
+
+            for (uint8_t i = 1; i < code; i++)
+            {
+                if (read >= length)
+                    return 0;
+                data[write++] = data[read++];
+            }
+
+            if ((code != 0xFF) && (read < length))
+                data[write++] = 0x00;
+        }
+        return write;
+    }
+
+    /**
+     * @brief  COBS encode a payload.
+     * @param  data    Payload to encode.
+     * @param  length  Number of payload bytes.
+     * @param  output  Buffer for the encoded bytes.  Must hold at
+     *                 least length + length / 254 + 1 bytes.
+     * @return Number of encoded bytes, without the delimiters.
+     */
+    inline auto cobs_encode(uint8_t const* data, size_t length, uint8_t* output) -> size_t
+    {
+        size_t code_index = 0;
+        size_t write = 1;
+        uint8_t code = 1;
+        for (size_t read = 0; read < length; read++)
+        {
+            if (data[read] != 0x00)
+            {
+                output[write++] = data[read];
+                code++;
+            }
+
+            if ((data[read] == 0x00) || (code == 0xFF))
+            {
+                output[code_index] = code;
+                code_index = write++;
+                code = 1;
+            }
+        }
+        output[code_index] = code;
+        return write;
+    }
+
+    /**
+     * @brief  Reads little-endian fields from a payload.
+     */
+    class FieldReader
+    {
+    public:
+
+        /**
+         * @brief  Constructor
+         * @param  data    Payload, without the CRC.
+         * @param  length  Number of bytes.
+         */
+        FieldReader(uint8_t const* data, size_t length)
+            :data_(data)
+            ,length_(length)
+        { };
+
+        /**
+         * @brief  Read an unsigned field.
+         * @param  value  Set to the field.
+         * @return false if the payload is too short.
+         */
+        template <typename T>
+        auto read(T& value) -> bool
+        {
+            if ((length_ - position_) < sizeof(T))
+                return false;
+
+            T result = 0;
+            for (size_t i = 0; i < sizeof(T); i++)
+                result |= static_cast<T>(static_cast<T>(data_[position_++]) << (8 * i));
+            value = result;
+            return true;
+        }
+
+        /**
+         * @brief  Read a boolean field, sent as a single byte.
+         * @param  value  Set to the field.
+         * @return false if the payload is too short or the byte isn't
+         *         0 or 1.
+         */
+        auto read(bool& value) -> bool
+        {
+            uint8_t byte = 0;
+            if (!read(byte) || (byte > 1))
+                return false;
+            value = (byte == 1);
+            return true;
+        }
+
+        /**
+         * @brief  Return true once every byte has been read.
+         */
+        auto at_end() -> bool
+        {
+            return position_ == length_;
+        }
+
+    private:
+
+        uint8_t const* data_;
+        size_t length_;
+        size_t position_ = 0;
+    };
+
+    /**
+     * @brief  Writes little-endian fields into a payload.
+     */
+    class FieldWriter
+    {
+    public:
+
+        /**
+         * @brief  Constructor
+         * @param  data      Buffer for the payload.
+         * @param  capacity  Size of the buffer.
+         */
+        FieldWriter(uint8_t* data, size_t capacity)
+            :data_(data)
+            ,capacity_(capacity)
+        { };
+
+        /**
+         * @brief  Write an unsigned field.
+         * @param  value  Field to write.
+         * @note   Fields that don't fit are dropped.
+         */
+        template <typename T>
+        auto write(T value) -> void
+        {
+            if ((capacity_ - length_) < sizeof(T))
+                return;
+
+            for (size_t i = 0; i < sizeof(T); i++)
+                data_[length_++] = static_cast<uint8_t>(value >> (8 * i));
+        }
+
+        /**
+         * @brief  Write a boolean field as a single byte.
+         * @param  value  Field to write.
+         */
+        auto write(bool value) -> void
+        {
+            write(static_cast<uint8_t>(value ? 1 : 0));
+        }
+
+        /**
+         * @brief  Write raw bytes, such as the text of a message.
+         * @param  text  Bytes to write.  Stops at 0x00.
+         * @note   Text that doesn't fit is cut short, leaving room
+         *         for the CRC.
+         */
+        auto write(char const* text) -> void
+        {
+            while (*text && ((length_ + CRC_LEN) < capacity_))
+                data_[length_++] = static_cast<uint8_t>(*text++);
+        }
+
+        /**
+         * @brief  Append the CRC of everything written so far.
+         */
+        auto seal() -> void
+        {
+            write(crc16(data_, length_));
+        }
+
+        /**
+         * @brief  Return the number of bytes written.
+         */
+        auto size() -> size_t
+        {
+            return length_;
+        }
+
+    private:
+
+        uint8_t* data_;
+        size_t capacity_;
+        size_t length_ = 0;
+    };
+}
@@ -0,0 +1,457 @@
+#pragma once
+
+#include <optional>
+
+#include "command_processor.hpp"
+#include "cy22150.hpp"
+#include "hop_table.hpp"
+#include "scheduler.hpp"
+#include "sweep_engine.hpp"
+#include "trigger_engine.hpp"
+
+namespace
+{
+    // Command numbers understood by the firmware.  These match the
+    // numbers used by python/cy22150.
+    //
+    enum command_number_t : int {
+        SET_FREQUENCY  = 100,
+        GET_FREQUENCY  = 101,
+        ENABLE_OUT     = 104,
+        DISABLE_OUT    = 105,
+        GET_STATE      = 106,
+        SET_HITLESS    = 107,
+        SET_MODE       = 108,
+        START_SWEEP    = 110,
+        STOP_SWEEP     = 111,
+        LOAD_HOPS      = 120,
+        HOP            = 121,
+        ARM_TRIGGER    = 122,
+        DISARM_TRIGGER = 123,
+        TIME_SYNC      = 130,
+        CLEAR_SCHEDULE = 131,
+        GET_LATENCY    = 132,
+    };
+
+    // Now the command dispatcher class.
+    //
+    class CommandDispatcher
+    {
+    public:
+        /**
+         * @brief  Class constructor
+         * @param  dds    Clock generator the commands act on.
+         * @param  sweep  Sweep engine driving the generator.
+         * @param  hops     Table of pre-solved frequencies.
+         * @param  trigger  GPIO trigger stepping through the hop table.
+         * @param  schedule Changes waiting to be applied at a given time.
+         * @param  processor  Command processor feeding the dispatcher.
+         */
+        CommandDispatcher(CY22150& dds, SweepEngine& sweep, HopTable& hops, TriggerEngine& trigger,
+                          Scheduler& schedule, CommandProcessor& processor) :
+            dds_(dds),
+            sweep_(sweep),
+            hops_(hops),
+            trigger_(trigger),
+            schedule_(schedule),
+            processor_(processor)
+        { }
+
+        /**
+         * @brief  Execute a command.
+         * @param  command  Command to be executed.
+         * @return Error if the command failed, nullopt otherwise.
+         *
+         * @note   Only commands that change the generator state commit
+         *         to the chip.  Queries are answered from the current
+         *         state without touching the I2C bus.
+         *
+         * @note   A command with an apply time is solved now and queued
+         *         to be applied at that time instead of being committed.
+         *
+         * @note   Settings staged by a command that fails are dropped.
+         */
+        auto dispatch(command_t const& command) -> std::optional<error_code_t>
+        {
+            command_entry_t const* entry = find_entry(command.command_number);
+            if (!entry)
+                return std::make_optional(error_code_t::UNKNOWN_COMMAND);
+
+            if (command.apply_at_us.has_value() && !entry->mutates)
+                return std::make_optional(error_code_t::NOT_SCHEDULABLE);
+
+            std::optional<error_code_t> error = std::nullopt;
+            if (entry->handler)
+                error = (this->*entry->handler)(command);
+
+            // A handler that fails may already have staged some of
+            // the command's settings.  They mustn't go out with the
+            // next commit.
+            //
+            if (error.has_value())
+                dds_.discard_changes();
+
+            if (error.has_value() || !entry->mutates)
+                return error;
+
+            return commit(command, command.apply_at_us);
+        }
+
+        /**
+         * @brief  Return true if a command can be coalesced with the
+         *         settings commands around it.
+         * @param  command  Command to check.
+         *
+         * @note   Only plain settings commands qualify.  Anything with
+         *         an error, an apply time or a batch of its own keeps
+         *         its place.
+         */
+        auto can_coalesce(command_t const& command) -> bool
+        {
+            command_entry_t const* entry = find_entry(command.command_number);
+            return entry && entry->mutates &&
+                   !command.error.has_value() &&
+                   !command.apply_at_us.has_value() &&
+                   (command.batch_size == 1);
+        }
+
+        /**
+         * @brief  Execute a batch of commands with a single commit.
+         * @param  commands  Commands to be executed.
+         * @param  count     Number of commands.
+         * @return Error if the batch was rejected, nullopt
+         *         otherwise.
+         *
+         * @note   Only commands that change the generator state can be
+         *         batched.  Every command is checked before any is
+         *         applied so a batch is applied whole or not at all.
+         *         If a handler fails anyway, what the batch staged is
+         *         dropped and nothing is committed.
+         *
+         * @note   If any command has an apply time the whole batch is
+         *         scheduled for it.  Different apply times are an error.
+         */
+        auto dispatch_batch(command_t const* const* commands, size_t count) -> std::optional<error_code_t>
+        {
+            std::optional<uint64_t> apply_at_us = std::nullopt;
+            for (size_t i = 0; i < count; i++)
+            {
+                command_entry_t const* entry = find_entry(commands[i]->command_number);
+                if (!entry)
+                    return std::make_optional(error_code_t::UNKNOWN_COMMAND);
+                if (!entry->mutates)
+                    return std::make_optional(error_code_t::NOT_BATCHABLE);
+
+                if (commands[i]->apply_at_us.has_value())
+                {
+                    if (apply_at_us.has_value() && (apply_at_us != commands[i]->apply_at_us))
+                        return std::make_optional(error_code_t::BATCH_APPLY_TIMES);
+                    apply_at_us = commands[i]->apply_at_us;
+                }
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                command_handler_t handler = find_entry(commands[i]->command_number)->handler;
+                std::optional<error_code_t> error = handler ? (this->*handler)(*commands[i]) : std::nullopt;
+                if (error.has_value())
+                {
+                    dds_.discard_changes();
+                    return error;
+                }
+            }
+
+            return commit(*commands[0], apply_at_us);
+        }
+
+    private:
+
+        // Dispatch table entry.
+        //
+        using command_handler_t = std::optional<error_code_t> (CommandDispatcher::*)(command_t const&);
+        using command_entry_t = struct {
+            int command_number;
+            command_handler_t handler;
+            bool mutates;
+        };
+
+        /**
+         * @brief  Look a command up in the dispatch table.
+         * @param  command_number  Command to look for.
+         * @return The table entry, or nullptr if there isn't one.
+         */
+        auto find_entry(int command_number) -> command_entry_t const*
+        {
+            for (auto const& entry : COMMAND_TABLE)
+            {
+                if (entry.command_number == command_number)
+                    return &entry;
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief  Commit the pending changes now, or schedule them.
+         * @param  command      Command the changes are reported against.
+         * @param  apply_at_us  When to apply the changes, or nullopt
+         *                      for now.
+         * @return Error if the changes couldn't be scheduled.
+         */
+        auto commit(command_t const& command, std::optional<uint64_t> apply_at_us) -> std::optional<error_code_t>
+        {
+            if (apply_at_us.has_value())
+            {
+                return schedule_.schedule(
+                    command.command_number,
+                    command.seq,
+                    apply_at_us.value(),
+                    dds_.solve_changes());
+            }
+
+            dds_.commit();
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Apply whichever settings are present in the command.
+         * @param  command  Command holding the settings.
+         * @return Always nullopt.
+         */
+        auto apply_settings(command_t const& command) -> std::optional<error_code_t>
+        {
+            if (command.frequency.has_value())
+            {
+                dds_.set_frequency(command.frequency.value());
+            }
+
+            if (command.enable_out.has_value())
+            {
+                dds_.set_enabled(command.enable_out.value());
+            }
+
+            if (command.hitless.has_value())
+            {
+                dds_.set_hitless(command.hitless.value());
+            }
+
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Turn hitless retuning on or off.
+         * @param  command  Command holding the hitless flag.
+         * @return Always nullopt.
+         *
+         * @note   Nothing else in the command is applied.  The command
+         *         doesn't commit, so a frequency or enable staged here
+         *         would go out with some later, unrelated command.
+         */
+        auto set_hitless(command_t const& command) -> std::optional<error_code_t>
+        {
+            if (command.hitless.has_value())
+            {
+                dds_.set_hitless(command.hitless.value());
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Turn the output on.
+         * @param  command  Command being executed.
+         * @return Always nullopt.
+         */
+        auto enable_out(command_t const& command) -> std::optional<error_code_t>
+        {
+            apply_settings(command);
+            dds_.set_enabled(true);
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Turn the output off.
+         * @param  command  Command being executed.
+         * @return Always nullopt.
+         */
+        auto disable_out(command_t const& command) -> std::optional<error_code_t>
+        {
+            apply_settings(command);
+            dds_.set_enabled(false);
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Start a frequency sweep.
+         * @param  command  Command holding the sweep settings.
+         * @return Error if the sweep couldn't be started.
+         *
+         * @note   The sweep engine commits each point itself.
+         */
+        auto start_sweep(command_t const& command) -> std::optional<error_code_t>
+        {
+            apply_settings(command);
+
+            SweepEngine::sweep_config_t config {
+                command.start.value_or(0),
+                command.stop.value_or(0),
+                command.step.value_or(0),
+                command.step_ppm.value_or(0),
+                command.dwell_us.value_or(0),
+                command.repeat.value_or(1),
+            };
+            return sweep_.start(config);
+        }
+
+        /**
+         * @brief  Stop a frequency sweep.
+         * @param  command  Command being executed.
+         * @return Always nullopt.
+         */
+        auto stop_sweep(command_t const& command) -> std::optional<error_code_t>
+        {
+            (void)command;
+            sweep_.stop();
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Load frequencies into the hop table.
+         * @param  command  Command holding the offset and frequencies.
+         * @return Error if the frequencies don't fit, or the trigger
+         *         is armed.
+         *
+         * @note   Entries are stored with the output enabled unless the
+         *         command says otherwise.
+         *
+         * @note   The trigger interrupt reads the table, so it can't be
+         *         rewritten under an armed trigger.
+         */
+        auto load_hops(command_t const& command) -> std::optional<error_code_t>
+        {
+            if (trigger_.is_armed())
+                return std::make_optional(error_code_t::HOP_TABLE_ARMED);
+
+            return hops_.load(
+                command.offset.value_or(0),
+                command.frequencies,
+                command.frequency_count,
+                command.enable_out.value_or(true));
+        }
+
+        /**
+         * @brief  Hop to an entry in the hop table.
+         * @param  command  Command holding the index.
+         * @return Error if there's no such entry.
+         */
+        auto hop(command_t const& command) -> std::optional<error_code_t>
+        {
+            if (!command.index.has_value())
+                return std::make_optional(error_code_t::HOP_INDEX_REQUIRED);
+
+            return hops_.hop(command.index.value());
+        }
+
+        /**
+         * @brief  Start hopping through the hop table on a GPIO edge.
+         * @param  command  Command holding the GPIO and edge.
+         * @return Error if the trigger couldn't be armed.
+         */
+        auto arm_trigger(command_t const& command) -> std::optional<error_code_t>
+        {
+            if (!command.gpio.has_value())
+                return std::make_optional(error_code_t::TRIGGER_GPIO_REQUIRED);
+
+            return trigger_.arm(command.gpio.value(), command.rising.value_or(true));
+        }
+
+        /**
+         * @brief  Stop hopping on a GPIO edge.
+         * @param  command  Command being executed.
+         * @return Always nullopt.
+         */
+        auto disarm_trigger(command_t const& command) -> std::optional<error_code_t>
+        {
+            (void)command;
+            trigger_.disarm();
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Drop scheduled changes that haven't been applied yet.
+         * @param  command  Command being executed.
+         * @return Always nullopt.
+         */
+        auto clear_schedule(command_t const& command) -> std::optional<error_code_t>
+        {
+            (void)command;
+            schedule_.clear();
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Set the command channel options: machine or
+         *         interactive mode, and coalescing of queued settings.
+         * @param  command  Command holding the machine and/or coalesce
+         *                  flags.
+         * @return Error if neither flag is present.
+         */
+        auto set_mode(command_t const& command) -> std::optional<error_code_t>
+        {
+            if (!command.machine.has_value() && !command.coalesce.has_value())
+                return std::make_optional(error_code_t::MODE_FLAG_REQUIRED);
+
+            if (command.machine.has_value())
+                processor_.set_machine_mode(command.machine.value());
+            if (command.coalesce.has_value())
+                processor_.set_coalescing(command.coalesce.value());
+            return std::nullopt;
+        }
+
+        /**
+         * @brief  Check the latency histograms can be reported.
+         * @param  command  Command being executed.
+         * @return Error if latency stats aren't built in.
+         *
+         * @note   The histograms go out with the ack, which resets
+         *         them.
+         */
+        auto get_latency(command_t const& command) -> std::optional<error_code_t>
+        {
+            (void)command;
+            if (!latency::ENABLED)
+                return std::make_optional(error_code_t::LATENCY_DISABLED);
+
+            return std::nullopt;
+        }
+
+        // Dispatch table.  Queries have no handler and don't commit.
+        // Every ack carries the device time, so a time sync is just
+        // a query.
+        // Setting the hitless flag only affects later commits.
+        //
+        static constexpr command_entry_t COMMAND_TABLE[] = {
+            { SET_FREQUENCY,  &CommandDispatcher::apply_settings,    true  },
+            { GET_FREQUENCY,  nullptr,                               false },
+            { ENABLE_OUT,     &CommandDispatcher::enable_out,        true  },
+            { DISABLE_OUT,    &CommandDispatcher::disable_out,       true  },
+            { GET_STATE,      nullptr,                               false },
+            { SET_HITLESS,    &CommandDispatcher::set_hitless,       false },
+            { SET_MODE,       &CommandDispatcher::set_mode,          false },
+            { START_SWEEP,    &CommandDispatcher::start_sweep,       false },
+            { STOP_SWEEP,     &CommandDispatcher::stop_sweep,        false },
+            { LOAD_HOPS,      &CommandDispatcher::load_hops,         false },
+            { HOP,            &CommandDispatcher::hop,               false },
+            { ARM_TRIGGER,    &CommandDispatcher::arm_trigger,       false },
+            { DISARM_TRIGGER, &CommandDispatcher::disarm_trigger,    false },
+            { TIME_SYNC,      nullptr,                               false },
+            { CLEAR_SCHEDULE, &CommandDispatcher::clear_schedule,    false },
+            { GET_LATENCY,    &CommandDispatcher::get_latency,       false },
+        };
+
+        CY22150& dds_;
+        SweepEngine& sweep_;
+        HopTable& hops_;
+        TriggerEngine& trigger_;
+        Scheduler& schedule_;
+        CommandProcessor& processor_;
+    };
+}
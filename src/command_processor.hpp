@@ -1,25 +1,133 @@
 #pragma once
 
-#include <vector>
-#include <iostream>
+#include <array>
 #include <optional>
 
 #include <stdio.h>
 #include <string.h>
 
+#include "binary_frame.hpp"
+#include "error_code.hpp"
+#include "frequency.hpp"
+#include "json_schema.hpp"
+#include "latency_stats.hpp"
+#include "line_receiver.hpp"
+#include "spsc_ring.hpp"
 #include "tiny-json.h"
+#include "tx_ring.hpp"
 
 namespace
 {
-    // Define the structure used to contain a DDS command.
+    // Most frequencies a single command can carry.
+    //
+    static const size_t MAX_COMMAND_FREQUENCIES = 32;
+
+    // Most commands in a single batch.
+    //
+    static const size_t MAX_BATCH_COMMANDS = 16;
+
+    // Presence bits for the fields of a binary command.  Fields
+    // that are present follow the mask in bit order.  Booleans are a
+    // single byte, frequencies are uint64 mHz, and frequencies is a
+    // uint8 count followed by that many uint64 mHz.
+    //
+    enum binary_field_t : uint32_t {
+        FIELD_FREQUENCY   = 1u << 0,
+        FIELD_ENABLE_OUT  = 1u << 1,
+        FIELD_HITLESS     = 1u << 2,
+        FIELD_MACHINE     = 1u << 3,
+        FIELD_START       = 1u << 4,
+        FIELD_STOP        = 1u << 5,
+        FIELD_STEP        = 1u << 6,
+        FIELD_STEP_PPM    = 1u << 7,
+        FIELD_DWELL_US    = 1u << 8,
+        FIELD_REPEAT      = 1u << 9,
+        FIELD_OFFSET      = 1u << 10,
+        FIELD_INDEX       = 1u << 11,
+        FIELD_GPIO        = 1u << 12,
+        FIELD_RISING      = 1u << 13,
+        FIELD_APPLY_AT_US = 1u << 14,
+        FIELD_FREQUENCIES = 1u << 15,
+        FIELD_SEQ         = 1u << 16,
+        FIELD_ACCEPT      = 1u << 17,
+        FIELD_COALESCE    = 1u << 18,
+        FIELD_ALL         = (1u << 19) - 1,
+    };
+
+    // Define the structure used to contain a DDS command.  Errors are
+    // codes, with the text looked up when the reply is sent, so the
+    // structure can be copied around without touching the heap.
+    // Commands that arrived as binary frames are answered with binary
+    // frames.  Every command in a batch carries the size of the batch.
+    // The stamps are empty unless latency stats are built in, and sit
+    // in the padding after the binary flag when they are.  The
+    // frequencies of a hop table load stay in the processor's staging
+    // buffer, which frequencies points to, so they aren't copied with
+    // every command.
     //
     using command_t = struct {
         int command_number = 0x00;
-        std::optional<uint32_t> frequency_hz = std::nullopt;
+        std::optional<millihertz_t> frequency = std::nullopt;
         std::optional<bool> enable_out = std::nullopt;
-        std::optional<std::string> error = std::nullopt;
+        std::optional<bool> hitless = std::nullopt;
+        std::optional<bool> machine = std::nullopt;
+        std::optional<bool> coalesce = std::nullopt;
+        std::optional<millihertz_t> start = std::nullopt;
+        std::optional<millihertz_t> stop = std::nullopt;
+        std::optional<millihertz_t> step = std::nullopt;
+        std::optional<uint32_t> step_ppm = std::nullopt;
+        std::optional<uint32_t> dwell_us = std::nullopt;
+        std::optional<uint32_t> repeat = std::nullopt;
+        std::optional<uint32_t> offset = std::nullopt;
+        std::optional<uint32_t> index = std::nullopt;
+        std::optional<uint32_t> gpio = std::nullopt;
+        std::optional<bool> rising = std::nullopt;
+        std::optional<uint64_t> apply_at_us = std::nullopt;
+        std::optional<uint32_t> seq = std::nullopt;
+        std::optional<bool> accept = std::nullopt;
+        millihertz_t* frequencies = nullptr;
+        uint8_t frequency_count = 0;
+        std::optional<error_code_t> error = std::nullopt;
+        bool binary = false;
+        latency::Stamps stamps {};
+        size_t batch_size = 1;
+    };
+
+    using command_field_t = json_schema::field_t<command_t, error_code_t>;
+
+    // JSON properties of a command.  Errors are shared by related
+    // properties so the replies haven't changed.  The command number
+    // is the only property a command has to have.
+    //
+    constexpr command_field_t COMMAND_FIELDS[] = {
+        { "command_number", json_schema::integer<&command_t::command_number>,  nullptr, error_code_t::COMMAND_NUMBER, true },
+        { "seq",            json_schema::integer<&command_t::seq>,             nullptr, error_code_t::PIPELINING_SETTINGS },
+        { "accept",         json_schema::boolean<&command_t::accept>,          nullptr, error_code_t::PIPELINING_SETTINGS },
+        { "enable_out",     json_schema::boolean<&command_t::enable_out>,      nullptr, error_code_t::ENABLE_FLAG },
+        { "hitless",        json_schema::boolean<&command_t::hitless>,         nullptr, error_code_t::HITLESS_FLAG },
+        { "machine",        json_schema::boolean<&command_t::machine>,         nullptr, error_code_t::MACHINE_FLAG },
+        { "coalesce",       json_schema::boolean<&command_t::coalesce>,        nullptr, error_code_t::COALESCE_FLAG },
+        { "frequency",      json_schema::frequency<&command_t::frequency>,     nullptr, error_code_t::FREQUENCY },
+        { "start",          json_schema::frequency<&command_t::start>,         nullptr, error_code_t::SWEEP_FREQUENCY },
+        { "stop",           json_schema::frequency<&command_t::stop>,          nullptr, error_code_t::SWEEP_FREQUENCY },
+        { "step",           json_schema::frequency<&command_t::step>,          nullptr, error_code_t::SWEEP_FREQUENCY },
+        { "step_ppm",       json_schema::integer<&command_t::step_ppm>,        nullptr, error_code_t::SWEEP_SETTINGS },
+        { "dwell_us",       json_schema::integer<&command_t::dwell_us>,        nullptr, error_code_t::SWEEP_SETTINGS },
+        { "repeat",         json_schema::integer<&command_t::repeat>,          nullptr, error_code_t::SWEEP_SETTINGS },
+        { "offset",         json_schema::integer<&command_t::offset>,          nullptr, error_code_t::HOP_SETTINGS },
+        { "index",          json_schema::integer<&command_t::index>,           nullptr, error_code_t::HOP_SETTINGS },
+        { "gpio",           json_schema::integer<&command_t::gpio>,            nullptr, error_code_t::TRIGGER_SETTINGS },
+        { "rising",         json_schema::boolean<&command_t::rising>,          nullptr, error_code_t::TRIGGER_SETTINGS },
+        { "apply_at_us",    json_schema::integer<&command_t::apply_at_us>,     nullptr, error_code_t::APPLY_TIME },
+        { "frequencies",    json_schema::frequencies<&command_t::frequencies, &command_t::frequency_count>,
+                            json_schema::frequency_entry<&command_t::frequencies, &command_t::frequency_count,
+                                                         MAX_COMMAND_FREQUENCIES>,
+                            error_code_t::FREQUENCIES },
     };
 
+    constexpr json_schema::Schema COMMAND_SCHEMA { COMMAND_FIELDS };
+    static_assert(COMMAND_SCHEMA.is_perfect(), "No perfect hash for the command fields");
+
     // Now the command receiver class.
     //
     class CommandProcessor
@@ -27,15 +135,16 @@ namespace
     public:
         /**
          * @brief  Class constructor
+         * @param  tx  Ring the prompt and echo are sent through.
          */
-        CommandProcessor() :
-            command_buffer_index_(0),
+        CommandProcessor(TxRing& tx) :
+            tx_(tx),
+            receiver_(tx),
             show_prompt_(false),
-            crlf_(false)
+            machine_mode_(false)
         {
-            // Zero out the command buffer.
-            //
-            reset_command_buffer();
+            receiver_.set_text_callback(on_text, this);
+            start_line();
         }
 
         /**
@@ -43,7 +152,7 @@ namespace
          */
         auto command_is_available() -> bool
         {
-            return commands_.size() > 0;
+            return commands_.size() > taken_;
         }
 
         /**
@@ -51,226 +160,848 @@ namespace
          */
         auto number_of_commands() -> int
         {
-            return commands_.size();
+            return commands_.size() - taken_;
         }
 
         /**
-         * @brief  Return the command at the top of the command fifo.
+         * @brief  Take the next command, or batch of commands, from the
+         *         command fifo.
+         * @param  batch  Set to point at the commands taken.
+         * @return Number of commands taken.
+         *
+         * @note   A batch is only ever put on the fifo whole, so the
+         *         rest of it is always there.
+         *
+         * @note   The commands are handed over where they sit on the
+         *         fifo rather than copied out.  They, and the
+         *         frequencies they carry, stay put until the next call
+         *         to get_batch() or loop().
          */
-        auto get_command() -> command_t
+        auto get_batch(std::array<command_t*, MAX_BATCH_COMMANDS>& batch) -> size_t
         {
-            command_t command {};
+            drop_taken();
+
+            command_t* first = commands_.peek();
+            if (!first)
+                return 0;
 
-            if (command_is_available())
+            size_t count = 0;
+            while ((count < first->batch_size) && (count < batch.size()))
             {
-                command = commands_[0];
-                commands_.erase(commands_.begin());
+                batch[count++] = take_command();
             }
+            return count;
+        }
+
+        /**
+         * @brief  Return the command after the ones taken, without
+         *         taking it.
+         * @return The command, or nullptr if the fifo has no more.
+         */
+        auto peek_command() -> command_t const*
+        {
+            return commands_.peek(taken_);
+        }
 
+        /**
+         * @brief  Take the command peek_command() returned, along with
+         *         the ones already taken.
+         * @return The command, or nullptr if the fifo has no more.
+         */
+        auto take_command() -> command_t*
+        {
+            command_t* command = commands_.peek(taken_);
+            if (command)
+                taken_++;
             return command;
         }
 
+        /**
+         * @brief  Return the most commands the fifo has held at once.
+         */
+        auto queue_high_water() -> uint32_t
+        {
+            return commands_.high_water();
+        }
+
+        /**
+         * @brief  Return the number of commands dropped because the
+         *         fifo was full.
+         */
+        auto queue_overflows() -> uint32_t
+        {
+            return commands_.overflows();
+        }
+
+        /**
+         * @brief  Return the latency histograms.
+         *
+         * @note   Commands are added once they've been answered, by
+         *         whoever answers them.
+         */
+        auto latency() -> latency::Stats&
+        {
+            return latency_;
+        }
+
+        /**
+         * @brief  Switch between interactive and machine mode.
+         * @param  flag  true for machine mode.
+         *
+         * @note   Machine mode turns off the echo and the prompt so
+         *         the only output is the JSON replies.
+         */
+        auto set_machine_mode(bool flag) -> void
+        {
+            machine_mode_ = flag;
+            receiver_.set_echo(!flag);
+        }
+
+        /**
+         * @brief  Return true in machine mode.
+         */
+        auto get_machine_mode() -> bool
+        {
+            return machine_mode_;
+        }
+
+        /**
+         * @brief  Turn coalescing of queued settings on or off.
+         * @param  flag  true to coalesce.
+         *
+         * @note   With coalescing on, settings commands waiting in the
+         *         fifo behind the one being executed are applied with
+         *         it, so only the newest settings are committed.
+         */
+        auto set_coalescing(bool flag) -> void
+        {
+            coalescing_ = flag;
+        }
+
+        /**
+         * @brief  Return true if queued settings are coalesced.
+         */
+        auto get_coalescing() -> bool
+        {
+            return coalescing_;
+        }
+
         /**
          * @brief  Method to execute instructions that look for
          *         incoming commands.
          */
         auto loop() -> void
         {
-            if (show_prompt_)
+            drop_taken();
+
+            if (show_prompt_ && !machine_mode_)
             {
                 display_prompt();       // Displays the prompt.
                 show_prompt(false);     // Resets the flag.
             }
 
-            // Get the character from stdio.  If it's a timeout 
-            // you can just leave the method.
+            // Take every complete line the fifo has room for, so that
+            // commands pile up behind a slow commit where coalescing
+            // can find them.  Lines are left in the receive ring while
+            // the fifo can't take a full batch so a pipelining client
+            // can't overrun it.
             //
-            int character = stdio_getchar_timeout_us(0);
-            if (character == PICO_ERROR_TIMEOUT)
-                return;
-
-            // If you get a LF right after a CR ignore it.  We
-            // map CR to LF below and don't want two in a row.
+            // Nothing more is taken while frequencies are waiting on the
+            // fifo either, or the next line's would overwrite them.
             //
-            if ((character == '\n') && (crlf_))
+            while (((commands_.capacity() - commands_.size()) >= MAX_BATCH_COMMANDS) && !frequencies_queued_)
             {
-                crlf_ = false;
-                return;
+                // Errors still owed to a batch that was too large go
+                // out before anything that came after it.
+                //
+                if (owed_errors_ > 0)
+                {
+                    push_owed_errors();
+                    continue;
+                }
+
+                // Get the next complete line from the receiver.  If
+                // there isn't one you can just leave the method.
+                //
+                std::optional<LineReceiver::line_t> line = receiver_.next_line();
+                if (!line.has_value())
+                    return;
+
+                take_line(line.value());
             }
+        }
+
+    private:
 
-            // We're mapping CR and LF to 0x00 since they are 
-            // considered to be line terminators.
+        static const size_t COMMAND_QUEUE_LEN = 2 * MAX_BATCH_COMMANDS;
+
+        /**
+         * @brief  Enable/disable showing the prompt.
+         * @note   This function only exists to help wtih code
+         *         readability.  Fully expect the compiler to
+         *         inline it.
+         */
+        auto show_prompt(bool flag) -> void 
+        {
+            show_prompt_ = flag;
+        }
+
+        /**
+         * @brief  Display the command line prompt.
+         */
+        auto display_prompt() -> void
+        {
+            tx_.send("$ ");
+        }
+
+        /**
+         * @brief  Text callback.  Feeds the next character of a command
+         *         line to the JSON parser.
+         * @param  context    The processor.
+         * @param  character  Character of the line, or 0x00 if the line
+         *                    has been thrown away.
+         */
+        static void on_text(void* context, char character)
+        {
+            CommandProcessor* processor = static_cast<CommandProcessor*>(context);
+            if (character == 0x00)
+            {
+                processor->abandon_line();
+            }
+            else
+            {
+                json_streamFeed(&processor->json_stream_, character);
+            }
+        }
+
+        /**
+         * @brief  Put the commands from a line on the fifo.
+         * @param  line  Line from the receiver.
+         *
+         * @note   Text lines have already been parsed as they arrived
+         *         so only the result is left to collect.  Binary frames
+         *         are parsed where they sit in the receive ring.
+         */
+        auto take_line(LineReceiver::line_t const& line) -> void
+        {
+            if (line.overflow)
+            {
+                command_t command {};
+                command.error = std::make_optional(error_code_t::COMMAND_TOO_LONG);
+                command.binary = line.binary;
+                command.stamps = line.stamps;
+                command.stamps.mark(latency::PARSE_DONE);
+                commands_.push(command);
+            }
+            else if (line.binary)
+            {
+                command_t command = parse_binary_command(
+                    reinterpret_cast<uint8_t*>(line.text), line.length);
+                command.stamps = line.stamps;
+                command.stamps.mark(latency::PARSE_DONE);
+                queue(command);
+            }
+            else if (line.length > 0)
+            {
+                finish_line(line.stamps);
+            }
+
+            if (!line.binary)
+                show_prompt(true);
+        }
+
+        /**
+         * @brief  Get ready to parse the next command line.
+         */
+        auto start_line() -> void
+        {
+            json_streamInit(&json_stream_, on_json, this);
+            line_batch_count_ = batch_count_;
+            command_depth_ = 1;
+            in_command_ = false;
+            array_field_ = nullptr;
+            batch_entries_ = 0;
+            more_ = std::nullopt;
+            batch_error_ = false;
+        }
+
+        /**
+         * @brief  Throw away a partly parsed command line, along with
+         *         any of its commands already added to the batch.
+         */
+        auto abandon_line() -> void
+        {
+            batch_count_ = line_batch_count_;
+            start_line();
+        }
+
+        /**
+         * @brief  Put the commands from a complete command line on the
+         *         fifo.
+         *
+         * @note   A line holding a JSON array is a batch.  So is a run
+         *         of lines with "batch":true on all but the last.  A
+         *         batch is held back until it's complete and then put
+         *         on the fifo in one go.
+         *
+         * @param  stamps  Latency stamps of the line, for each of its
+         *                 commands.
+         */
+        auto finish_line(latency::Stamps const& stamps) -> void
+        {
+            // Commands in an array were added as they were parsed,
+            // before the line was complete, so they're stamped now.
             //
-            crlf_ = (character == '\r');
-            if ((character == '\r') || (character == '\n'))
+            line_stamps_ = stamps;
+            for (size_t i = line_batch_count_; (i < batch_count_) && (i < MAX_BATCH_COMMANDS); i++)
             {
-                character = 0x00;
+                batch_[i].stamps.merge(stamps);
             }
 
-            // At this point we should have handled any special
-            // characters and/or character mapping.
+            // If the line isn't valid JSON the error replaces anything
+            // it added and ends any batch in progress.
             //
-            if (character == 0x00)
+            if (JSON_STREAM_DONE != json_streamStatus(&json_stream_))
+            {
+                batch_count_ = line_batch_count_;
+                command_t command {};
+                command.error =
+                    std::make_optional(error_code_t::JSON_INVALID);
+                add_to_batch(command);
+                close_batch();
+            }
+            else if (command_depth_ == 2)
+            {
+                if (batch_entries_ == 0)
+                {
+                    command_t command {};
+                    command.error = std::make_optional(error_code_t::BATCH_EMPTY);
+                    add_to_batch(command);
+                }
+                close_batch();
+            }
+            else
             {
-                // The incoming character is a line terminator so
-                // process the command.  Once you've processed the 
-                // command be sure to reset the buffer and command index.
+                if (batch_error_ && !command_.error.has_value())
+                {
+                    command_.error =
+                        std::make_optional(error_code_t::BATCH_FLAG);
+                }
+
+                // A command on its own goes straight on the fifo.  Only
+                // a batch has to be held back.
                 //
-                if (command_buffer_index_ > 0)
+                if ((batch_count_ == 0) && !more_.value_or(false))
                 {
-                    add_command_to_fifo();
-                    reset_command_buffer();
+                    command_.stamps.merge(line_stamps_);
+                    command_.stamps.mark(latency::PARSE_DONE);
+                    queue(command_);
+                }
+                else
+                {
+                    add_to_batch(command_);
+                    if (!more_.value_or(false))
+                    {
+                        close_batch();
+                    }
                 }
-                reflect(character);
-                show_prompt(true);
             }
-            else if (command_buffer_index_ >= MAX_COMMAND_LEN)
+
+            start_line();
+        }
+
+        /**
+         * @brief  Hold a command back until its batch is complete.
+         * @param  command  Command to add.
+         *
+         * @note   The command takes the latency stamps of the last
+         *         complete line.  One added while its own line is still
+         *         arriving is stamped again by finish_line().
+         */
+        auto add_to_batch(command_t const& command) -> void
+        {
+            if (batch_count_ < MAX_BATCH_COMMANDS)
+            {
+                batch_[batch_count_] = command;
+                batch_[batch_count_].stamps.merge(line_stamps_);
+            }
+            batch_count_++;
+        }
+
+        /**
+         * @brief  Put the batch in progress on the fifo.
+         *
+         * @note   Every command in a batch that's too big gets an error,
+         *         so the client hears back once per command as usual.
+         *         Only the first MAX_BATCH_COMMANDS were kept.  They go
+         *         on the fifo with their errors, and the rest are owed
+         *         an error each, without a command number or sequence
+         *         number, which loop() sends as the fifo has room.
+         */
+        auto close_batch() -> void
+        {
+            if (batch_count_ > MAX_BATCH_COMMANDS)
             {
-                // There's no room in the command buffer so there's
-                // nothing to do.  Just ignore the incoming character.
+                owed_errors_ += batch_count_ - MAX_BATCH_COMMANDS;
+                batch_count_ = MAX_BATCH_COMMANDS;
+                for (size_t i = 0; i < batch_count_; i++)
+                {
+                    batch_[i].error = std::make_optional(error_code_t::BATCH_TOO_LARGE);
+                }
             }
-            else if ((character >= 32) && (character <= 128))
+
+            for (size_t i = 0; i < batch_count_; i++)
             {
-                // Reflect the character back to provide feedback and
-                // put it in the buffer.
-                //
-                reflect(character);
-                command_buffer_[command_buffer_index_++] = static_cast<char>(character);
+                batch_[i].batch_size = batch_count_;
+                batch_[i].stamps.mark(latency::PARSE_DONE);
+                queue(batch_[i]);
             }
+            batch_count_ = 0;
         }
 
-    private:
+        /**
+         * @brief  Put as many errors owed to a batch that was too large
+         *         on the fifo as it has room for.
+         */
+        auto push_owed_errors() -> void
+        {
+            while ((owed_errors_ > 0) && (commands_.size() < commands_.capacity()))
+            {
+                command_t command {};
+                command.error = std::make_optional(error_code_t::BATCH_TOO_LARGE);
+                commands_.push(command);
+                owed_errors_--;
+            }
+        }
 
-        static const int COMMAND_BUFFER_LEN = 1024;
-        static const int MAX_COMMAND_LEN = COMMAND_BUFFER_LEN - 1;
-        static const int MAX_JSON_DEPTH = 8;
+        /**
+         * @brief  Put a command on the fifo.
+         * @param  command  Command to add.
+         */
+        auto queue(command_t const& command) -> void
+        {
+            if (commands_.push(command) && (command.frequency_count > 0))
+                frequencies_queued_ = true;
+        }
 
         /**
-         * @brief  Send a single character out the stdio.
-         * @param  character  Character to be sent.
+         * @brief  Return the staging buffer if no other command has
+         *         frequencies in it.
+         * @return The buffer, or nullptr if it's taken.
+         *
+         * @note   Whatever holds the frequencies is either on the fifo
+         *         or in the batch being built.
          */
-        auto reflect(int character) -> void
+        auto free_frequencies() -> millihertz_t*
         {
-            std::cout << ((character == 0x00) ? '\n' : static_cast<char>(character));
-            std::cout << std::flush;
+            if (frequencies_queued_)
+                return nullptr;
+
+            for (size_t i = 0; (i < batch_count_) && (i < MAX_BATCH_COMMANDS); i++)
+            {
+                if (batch_[i].frequency_count > 0)
+                    return nullptr;
+            }
+            return frequencies_.data();
         }
 
         /**
-         * @brief  Enable/disable showing the prompt.
-         * @note   This function only exists to help wtih code
-         *         readability.  Fully expect the compiler to
-         *         inline it.
+         * @brief  Remove the commands handed out by get_batch() and
+         *         take_command() from the fifo.
+         *
+         * @note   This frees the staging buffer if one of them was
+         *         holding it.
          */
-        auto show_prompt(bool flag) -> void 
+        auto drop_taken() -> void
         {
-            show_prompt_ = flag;
+            for (size_t i = 0; i < taken_; i++)
+            {
+                if (commands_.peek(i)->frequency_count > 0)
+                    frequencies_queued_ = false;
+            }
+            commands_.drop(taken_);
+            taken_ = 0;
         }
 
         /**
-         * @brief  Display the command line prompt.
+         * @brief  JSON parser callback.
+         * @param  context  The processor.
+         * @note   The other parameters are as for parse_event().
          */
-        auto display_prompt() -> void
+        static void on_json(void* context, jsonEvent_t event, jsonType_t type,
+                            char const* name, char const* value, unsigned int depth)
+        {
+            static_cast<CommandProcessor*>(context)->parse_event(event, type, name, value, depth);
+        }
+
+        /**
+         * @brief  Fill in the command being parsed from the next JSON
+         *         event.
+         * @param  event  What the parser found.
+         * @param  type   Type of the property.
+         * @param  name   Name of the property, if it has one.
+         * @param  value  Text of the property, for JSON_VALUE.
+         * @param  depth  Number of objects and arrays the property is in.
+         *
+         * @note   This runs as each property arrives, so by the time the
+         *         end of the line turns up the command is complete.
+         */
+        auto parse_event(jsonEvent_t event, jsonType_t type, char const* name,
+                         char const* value, unsigned int depth) -> void
+        {
+            // The root decides whether the line is a single command or
+            // a batch.
+            //
+            if (depth == 0)
+            {
+                if ((JSON_BEGIN == event) && (JSON_OBJ == type))
+                {
+                    start_command();
+                }
+                else if (JSON_BEGIN == event)
+                {
+                    command_depth_ = 2;
+                }
+                else if (JSON_OBJ == type)
+                {
+                    finish_command();
+                }
+                return;
+            }
+
+            // Entries of a batch.  Anything other than an object can't
+            // be a command.
+            //
+            if ((depth == 1) && (command_depth_ == 2))
+            {
+                if (JSON_END == event)
+                {
+                    if (JSON_OBJ == type)
+                    {
+                        finish_command();
+                        add_to_batch(command_);
+                    }
+                    return;
+                }
+
+                batch_entries_++;
+                if ((JSON_BEGIN == event) && (JSON_OBJ == type))
+                {
+                    start_command();
+                }
+                else
+                {
+                    command_t command {};
+                    command.error =
+                        std::make_optional(error_code_t::COMMAND_NUMBER);
+                    add_to_batch(command);
+                }
+                return;
+            }
+
+            if (!in_command_)
+                return;
+
+            // Properties of the command, then the entries of an array
+            // property.
+            //
+            if (depth == command_depth_)
+            {
+                if (JSON_END == event)
+                {
+                    array_field_ = nullptr;
+                }
+                else
+                {
+                    parse_property(name, type, value);
+                }
+            }
+            else if (array_field_ && (depth == command_depth_ + 1) && (JSON_END != event))
+            {
+                if (!array_field_->entry(command_, type, value))
+                    fail(array_field_->error);
+            }
+        }
+
+        /**
+         * @brief  Start filling in a new command.
+         */
+        auto start_command() -> void
         {
-            std::cout << "$ " << std::flush;
+            command_ = command_t {};
+            command_.frequencies = free_frequencies();
+            seen_ = 0;
+            in_command_ = true;
+            array_field_ = nullptr;
         }
 
         /**
-         * @brief  Pull command from the buffer and put it on the fifo
+         * @brief  Finish off the command being filled in.
+         *
+         * @note   A problem with a required property takes priority
+         *         over any other error.
          */
-        auto add_command_to_fifo() -> void
+        auto finish_command() -> void
         {
-            std::optional<command_t> command = parse_json_command_buffer();
-            commands_.push_back(command.value());
+            in_command_ = false;
+            array_field_ = nullptr;
+
+            command_field_t const* missing = COMMAND_SCHEMA.missing(seen_);
+            if (missing)
+            {
+                command_.error = std::make_optional(missing->error);
+            }
         }
 
         /**
-         * @brief  Reinitialize the command buffer.  Sets all values to 0x00
-         *         and the length to zero.
+         * @brief  Record the first error found in the command being
+         *         filled in.
+         * @param  error  The error.
          */
-        auto reset_command_buffer() -> void
+        auto fail(error_code_t error) -> void
         {
-            memset(command_buffer_, 0x00, COMMAND_BUFFER_LEN);
-            command_buffer_index_ = 0;
+            if (!command_.error.has_value())
+            {
+                command_.error = std::make_optional(error);
+            }
+        }
+
+        /**
+         * @brief  Fill in a property of the command being parsed.
+         * @param  name   Name of the property.
+         * @param  type   Type of the property.
+         * @param  value  Text of the property.  nullptr for an object or
+         *                array.
+         *
+         * @note   Unknown properties are ignored.
+         */
+        auto parse_property(char const* name, jsonType_t type, char const* value) -> void
+        {
+            command_field_t const* field = COMMAND_SCHEMA.find(name);
+            if (field)
+            {
+                if (field->entry && !command_.frequencies)
+                {
+                    fail(error_code_t::FREQUENCIES_HELD);
+                    return;
+                }
+
+                if (!field->set(command_, type, value))
+                {
+                    fail(field->error);
+                    return;
+                }
+
+                seen_ |= COMMAND_SCHEMA.bit(field);
+                if (field->entry)
+                    array_field_ = field;
+            }
+
+            // Only a command on its own can be part of a run of lines.
+            //
+            else if ((command_depth_ == 1) && (0 == strcmp(name, "batch")))
+            {
+                batch_error_ = !json_schema::parse_boolean(type, value, more_);
+            }
         }
 
         /**
-         * @brief  Parse the command buffer to retrieve a command.
+         * @brief  Parse a binary command frame.
+         * @param  frame   COBS encoded frame, without the delimiters.
+         *                 Decoded in place.
+         * @param  length  Number of bytes in the frame.
          */
-        auto parse_json_command_buffer() -> std::optional<command_t>
+        auto parse_binary_command(uint8_t* frame, size_t length) -> command_t
         {
-            std::string command(command_buffer_);
             command_t command_struct;
+            command_struct.binary = true;
 
-            // Convert incoming command buffer to a json object.  
-            // If conversion fails just return the default 
-            // command structure.
+            // Check the framing and the CRC before looking at any of
+            // the fields.
             //
-            json_t mem[MAX_JSON_DEPTH];
-            json_t const* json = json_create( command_buffer_, mem, sizeof(mem) / sizeof(*mem) );
-            if (!json)
+            size_t decoded = binary_frame::cobs_decode(frame, length);
+            if ((decoded <= binary_frame::CRC_LEN) || (decoded > binary_frame::MAX_PAYLOAD_LEN))
             {
-                command_struct.error = 
-                    std::make_optional("Error creating json from command buffer");
+                command_struct.error =
+                    std::make_optional(error_code_t::BINARY_FRAME);
                 return command_struct;
             }
 
-            // The command number is a required field.
+            size_t payload = decoded - binary_frame::CRC_LEN;
+            uint16_t crc = 0;
+            binary_frame::FieldReader(frame + payload, binary_frame::CRC_LEN).read(crc);
+            if (crc != binary_frame::crc16(frame, payload))
+            {
+                command_struct.error =
+                    std::make_optional(error_code_t::BINARY_CRC);
+                return command_struct;
+            }
+
+            // The command number and presence mask are required.
             //
-            json_t const* command_number = json_getProperty(json, "command_number");
-            if (!command_number || (JSON_INTEGER != json_getType(command_number)))
+            binary_frame::FieldReader reader(frame, payload);
+            uint16_t command_number = 0;
+            uint32_t present = 0;
+            if (!reader.read(command_number) || !reader.read(present) || ((present & ~FIELD_ALL) != 0))
             {
                 command_struct.error =
-                    std::make_optional("Error parsing command number");
+                    std::make_optional(error_code_t::BINARY_HEADER);
                 return command_struct;
             }
-            command_struct.command_number =
-                static_cast<uint32_t>(json_getInteger(command_number));
+            command_struct.command_number = command_number;
 
-            // Now pull out the properties of interest and return the completed
-            // command structure.
+            // Now pull out whichever fields are present, in bit order.
             //
-            json_t const* enable_out = json_getProperty(json, "enable_out");
-            if (enable_out)
+            bool ok =
+                read_frequency(reader, present, FIELD_FREQUENCY,   command_struct.frequency)       &&
+                read_field    (reader, present, FIELD_ENABLE_OUT,  command_struct.enable_out)      &&
+                read_field    (reader, present, FIELD_HITLESS,     command_struct.hitless)         &&
+                read_field    (reader, present, FIELD_MACHINE,     command_struct.machine)         &&
+                read_frequency(reader, present, FIELD_START,       command_struct.start)           &&
+                read_frequency(reader, present, FIELD_STOP,        command_struct.stop)            &&
+                read_frequency(reader, present, FIELD_STEP,        command_struct.step)            &&
+                read_field    (reader, present, FIELD_STEP_PPM,    command_struct.step_ppm)        &&
+                read_field    (reader, present, FIELD_DWELL_US,    command_struct.dwell_us)        &&
+                read_field    (reader, present, FIELD_REPEAT,      command_struct.repeat)          &&
+                read_field    (reader, present, FIELD_OFFSET,      command_struct.offset)          &&
+                read_field    (reader, present, FIELD_INDEX,       command_struct.index)           &&
+                read_field    (reader, present, FIELD_GPIO,        command_struct.gpio)            &&
+                read_field    (reader, present, FIELD_RISING,      command_struct.rising)          &&
+                read_field    (reader, present, FIELD_APPLY_AT_US, command_struct.apply_at_us);
+
+            if (ok && ((present & FIELD_FREQUENCIES) != 0))
             {
-                if (JSON_BOOLEAN != json_getType( enable_out ))
+                command_struct.frequencies = free_frequencies();
+                if (!command_struct.frequencies)
                 {
                     command_struct.error =
-                        std::make_optional("Error parsing enable flag.");
+                        std::make_optional(error_code_t::FREQUENCIES_HELD);
                     return command_struct;
                 }
-                command_struct.enable_out =
-                    std::make_optional(json_getBoolean( enable_out ));
-            }
 
-            json_t const* frequency_hz = json_getProperty(json, "frequency");
-            if (frequency_hz)
-            {
-                if (JSON_INTEGER != json_getType( frequency_hz ))
+                uint8_t count = 0;
+                ok = reader.read(count) && (count <= MAX_COMMAND_FREQUENCIES);
+                for (uint8_t i = 0; ok && (i < count); i++)
                 {
-                    command_struct.error =
-                        std::make_optional("Error parsing frequency.");
-                    return command_struct;
+                    ok = reader.read(command_struct.frequencies[i]) &&
+                         (command_struct.frequencies[i] <= frequency::MAX_MILLIHZ);
                 }
-                command_struct.frequency_hz = 
-                    std::make_optional(static_cast<uint32_t>(json_getInteger( frequency_hz )));
+                command_struct.frequency_count = ok ? count : 0;
+            }
+
+            ok = ok &&
+                read_field    (reader, present, FIELD_SEQ,         command_struct.seq)             &&
+                read_field    (reader, present, FIELD_ACCEPT,      command_struct.accept)          &&
+                read_field    (reader, present, FIELD_COALESCE,    command_struct.coalesce);
+
+            if (!ok || !reader.at_end())
+            {
+                command_struct.error =
+                    std::make_optional(error_code_t::BINARY_FIELDS);
+                return command_struct;
             }
 
             return command_struct;
         }
 
+        /**
+         * @brief  Read an optional binary command field.
+         * @param  reader   Reader positioned at the field.
+         * @param  present  Presence mask from the frame.
+         * @param  field    Presence bit of the field.
+         * @param  value    Set to the field if it's present.
+         * @return false if the field is present but can't be read.
+         */
+        template <typename T>
+        auto read_field(binary_frame::FieldReader& reader, uint32_t present, uint32_t field,
+                        std::optional<T>& value) -> bool
+        {
+            if ((present & field) == 0)
+                return true;
+
+            T field_value {};
+            if (!reader.read(field_value))
+                return false;
+
+            value = std::make_optional(field_value);
+            return true;
+        }
+
+        /**
+         * @brief  Read an optional binary frequency field.
+         * @param  reader   Reader positioned at the field.
+         * @param  present  Presence mask from the frame.
+         * @param  field    Presence bit of the field.
+         * @param  value    Set to the frequency, in mHz, if it's present.
+         * @return false if the field is present but can't be read or
+         *         is out of range.
+         */
+        auto read_frequency(binary_frame::FieldReader& reader, uint32_t present, uint32_t field,
+                            std::optional<millihertz_t>& value) -> bool
+        {
+            return read_field(reader, present, field, value) &&
+                   (value.value_or(0) <= frequency::MAX_MILLIHZ);
+        }
 
-        // FIFO for storing received commands.
+        // FIFO for storing received commands.  The parser is the
+        // producer and the main loop the consumer.  taken_ commands at
+        // the front have been handed out and are dropped once the
+        // main loop is back for more.
         //
-        std::vector<command_t> commands_ {  };
+        SpscRing<command_t, COMMAND_QUEUE_LEN> commands_ {  };
+        size_t taken_ = 0;
 
-        // Buffer used to store incoming chaacters.
+        // Batch waiting for its last command.
         //
-        char command_buffer_[COMMAND_BUFFER_LEN];
-        int command_buffer_index_;
+        std::array<command_t, MAX_BATCH_COMMANDS> batch_ {  };
+        size_t batch_count_ = 0;
+
+        // Staging buffer for the frequencies of a hop table load.
+        // Only one command at a time can hold it, and it's held while
+        // that command is on the fifo.
+        //
+        std::array<millihertz_t, MAX_COMMAND_FREQUENCIES> frequencies_ {  };
+        bool frequencies_queued_ = false;
+
+        // Incremental JSON parser and the command it's filling in.
+        // command_depth_ is how deep the command's properties are: 1
+        // for a command on its own and 2 for the commands in an array.
+        // seen_ has a COMMAND_SCHEMA bit set for each property parsed.
+        // line_batch_count_ is the size of the batch before the line
+        // started, so a bad line can take back what it added.
+        //
+        jsonStream_t json_stream_ {  };
+        command_t command_ {  };
+        unsigned int command_depth_ = 1;
+        bool in_command_ = false;
+        command_field_t const* array_field_ = nullptr;
+        uint32_t seen_ = 0;
+        std::optional<bool> more_ = std::nullopt;
+        bool batch_error_ = false;
+        size_t batch_entries_ = 0;
+        size_t line_batch_count_ = 0;
+
+        // Errors still to be sent for the commands of a batch that
+        // were past MAX_BATCH_COMMANDS.
+        //
+        size_t owed_errors_ = 0;
+
+        // Source of incoming command lines, and where the prompt goes.
+        //
+        TxRing& tx_;
+        LineReceiver receiver_;
 
         // Flags used to control local state.
         //
         bool show_prompt_;
-        bool crlf_;
+        bool machine_mode_;
+        bool coalescing_ = false;
+
+        // Latency stamps of the last complete line, and the histograms
+        // answered commands are added to.  Both are empty, and take no
+        // space, unless latency stats are built in.
+        //
+        [[no_unique_address]] latency::Stamps line_stamps_ {};
+        [[no_unique_address]] latency::Stats latency_ {};
     };
 }
\ No newline at end of file
@@ -1,28 +1,62 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <optional>
 #include <utility>
 
-#include "hardware/structs/i2c.h"
-
-class CY22150
+#include "pico/time.h"
+
+#include "frequency.hpp"
+#include "latency_stats.hpp"
+#include "pll_solver.hpp"
+
+/**
+ * @brief  Driver for the CY22150.
+ *
+ * @note   The bus is a template parameter, so the driver doesn't care
+ *         what it's talking to as long as it has a write() like
+ *         PicoI2cBus.  On the Pico that's the I2C hardware, and there
+ *         is no indirection in the way.  A host build can put a mock
+ *         bus underneath to record or check what gets sent.
+ */
+template <typename Bus>
+class CY22150Driver
 {
 public:
 
     static const uint8_t I2C_ADDRESS = 0x69;
-    static constexpr float FREQ_DEFAULT = 4000000.0;
+    static constexpr millihertz_t FREQ_DEFAULT = frequency::from_hz(4000000);
+
+    // Everything needed to put the chip in a given state.  The PLL
+    // counters are kept alongside the register values so hitless
+    // steps can be recognised without decoding the registers.
+    //
+    using register_image_t = struct {
+        millihertz_t frequency;
+        PllSolver::pll_settings_t pll;
+        uint8_t reg40;
+        uint8_t reg41;
+        uint8_t reg42;
+        uint8_t dvdr;
+        uint8_t clkoe;
+    };
 
     /**
      * @brief  Constructor
      * 
-     * @param  i2c            I2C interface to be used to communicate 
-     *                        wtih the chip
-     * @param  clock_freq_hz  Clock signal frequency, in Hz
+     * @param  bus            Bus to be used to communicate wtih the 
+     *                        chip
+     * @param  clock_freq     Clock signal frequency, in mHz
+     * @param  frequency      Default output frequency, in mHz
      */
-    CY22150(i2c_inst_t* i2c, float clock_freq_hz, float frequency = FREQ_DEFAULT)
-        :i2c_(i2c)
-        ,clock_freq_hz_(clock_freq_hz)
+    CY22150Driver(Bus bus, millihertz_t clock_freq, millihertz_t frequency = FREQ_DEFAULT)
+        :bus_(bus)
+        ,clock_freq_(clock_freq)
+        ,solver_(clock_freq)
         ,current_state_({frequency, DISABLE })
-        ,temp_state_({frequency, DISABLE })
+        ,temp_state_({ std::nullopt, std::nullopt })
         ,default_state_({frequency, DISABLE })
     { };
 
@@ -36,17 +70,18 @@ public:
         // Initialize the clock drive.
         //
         int8_t xdrv = 
-            (clock_freq_hz_ <=   1000000) ? 0x00 :
-            (clock_freq_hz_ <=  25000000) ? 0x20 :
-            (clock_freq_hz_ <=  50000000) ? 0x28 :
-            (clock_freq_hz_ <=  90000000) ? 0x30 :
-            (clock_freq_hz_ <= 133000000) ? 0x38 :
+            (clock_freq_ <= frequency::from_hz(  1000000)) ? 0x00 :
+            (clock_freq_ <= frequency::from_hz( 25000000)) ? 0x20 :
+            (clock_freq_ <= frequency::from_hz( 50000000)) ? 0x28 :
+            (clock_freq_ <= frequency::from_hz( 90000000)) ? 0x30 :
+            (clock_freq_ <= frequency::from_hz(133000000)) ? 0x38 :
             0x00;
-        write_reg(XDRV, xdrv);
+        stage_reg(XDRV, xdrv);
 
         // Set the clock generator to the default state.
         //
         commit_disable_clock();
+        flush();
         set_frequency(default_state_.frequency);
         set_enabled(default_state_.enable);
         commit();
@@ -71,55 +106,229 @@ public:
 
     /**
      * @brief  Set the clock frequency.
-     * @param  frequency  Desired clock frequency, in Hz.
+     * @param  frequency  Desired clock frequency, in mHz.
      */
-    auto set_frequency(float frequency) -> void
+    auto set_frequency(millihertz_t frequency) -> void
     {
         temp_state_.frequency = frequency;
     }
 
     /**
-     * @brief  Return the current clock frequency.
+     * @brief  Return the current clock frequency, in mHz.
      */
-    auto get_frequency() -> float
+    auto get_frequency() -> millihertz_t
     {
         return current_state_.frequency;
     }
 
+    /**
+     * @brief  Enable/disable hitless retuning.
+     * @param  hitless  Leave the output on for small retunes if true.
+     * 
+     * @note   In hitless mode P-only steps of up to 1/HITLESS_P_STEP
+     *         of the current P, and divider-only steps, are written
+     *         with the output left enabled.
+     */
+    auto set_hitless(bool hitless) -> void
+    {
+        hitless_ = hitless;
+    }
+
+    /**
+     * @brief  Return the hitless retune flag.
+     */
+    auto get_hitless() -> bool
+    {
+        return hitless_;
+    }
+
+    /**
+     * @brief  Return how long the output was dark during the last 
+     *         commit, in microseconds.
+     * 
+     * @note   Zero if the output stayed on, or wasn't on to begin with.
+     */
+    auto get_dark_window_us() -> uint32_t
+    {
+        return dark_window_us_;
+    }
+
+    /**
+     * @brief  Return how long the last commit took, from the start of
+     *         the first register write to the end of the last one, in
+     *         microseconds.
+     */
+    auto get_commit_us() -> uint32_t
+    {
+        return commit_us_;
+    }
+
     /**
      * @brief  Commit changes to the CY22150.
+     * 
+     * @note   Anything not changed since the last commit keeps its
+     *         current value, even if the current state was changed 
+     *         by apply() in the meantime.
+     *
+     * @note   The end of the solve and of the register writes are
+     *         stamped here rather than in apply(), which interrupt
+     *         handlers call as well.
      */
     auto commit() -> void
     {
-        // Commit state to the CY22150 and save it as the
-        // current state.
+        register_image_t image = solve_changes();
+        stamps_.mark(latency::SOLVE_DONE);
+        apply(image);
+        stamps_.mark(latency::I2C_DONE);
+    }
+
+    /**
+     * @brief  Work out the register image for the changes waiting to
+     *         be committed, without touching the chip.
+     * 
+     * @return Register image, ready to be applied.
+     * 
+     * @note   The changes are consumed, as if they had been committed.
+     */
+    auto solve_changes() -> register_image_t
+    {
+        register_image_t image = solve(
+            temp_state_.frequency.value_or(current_state_.frequency),
+            temp_state_.enable.value_or(current_state_.enable));
+        temp_state_ = { std::nullopt, std::nullopt };
+        return image;
+    }
+
+    /**
+     * @brief  Drop the changes waiting to be committed.
+     */
+    auto discard_changes() -> void
+    {
+        temp_state_ = { std::nullopt, std::nullopt };
+    }
+
+    /**
+     * @brief  Work out the register image for a clock state without
+     *         touching the chip.
+     * 
+     * @param  frequency  Desired clock frequency, in mHz.
+     * @param  enable     Enable clock if true, false otherwise.
+     * 
+     * @return Register image, ready to be applied.
+     */
+    auto solve(millihertz_t frequency, bool enable) -> register_image_t
+    {
+        PllSolver::pll_settings_t pll = solver_.solve(frequency);
+        register_image_t image = encode(pll.q, pll.p, pll.d);
+        image.clkoe = enable ? CLOCK2 : NONE;
+        return image;
+    }
+
+    /**
+     * @brief  Write a register image to the CY22150 and make it the 
+     *         current state.
+     * 
+     * @param  image  Register image, from solve().
+     */
+    auto apply(register_image_t const& image) -> void
+    {
+        // The fences keep the compiler from moving the state updates
+        // outside the busy window, where an interrupt handler checking
+        // is_busy() would see them half done.
         //
-        commit_disable_clock();
-        temp_state_.frequency = frequency_commit(temp_state_.frequency);
-        temp_state_.enable ? commit_enable_clock() : commit_disable_clock();
+        busy_ = true;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        uint64_t start_us = time_us_64();
+        bool was_enabled = current_state_.enable;
+        bool enable = (image.clkoe != NONE);
+        dark_window_us_ = 0;
+
+        // Anything that doesn't need the output off goes out first so
+        // it doesn't stretch the dark window.
+        //
+        if (enable)
+        {
+            commit_crosspoint(image.clkoe);
+        }
 
-        current_state_.frequency = temp_state_.frequency;
-        current_state_.enable = temp_state_.enable;
+        // The PLL registers are staged in the shadow copy next.  The
+        // output only has to be dropped while they are rewritten if 
+        // any of them actually changed, and not even then if this is
+        // a hitless step.
+        //
+        stage_reg(REG40, image.reg40);
+        stage_reg(REG41, image.reg41);
+        stage_reg(REG42, image.reg42);
+        stage_reg(DVDR,  image.dvdr);
+        if (pll_is_dirty())
+        {
+            if (was_enabled && hitless_ && pll_step_is_hitless(image.pll))
+            {
+                flush();
+            }
+            else
+            {
+                uint64_t dark_start_us = time_us_64();
+                commit_disable_clock();
+                flush();
+                commit_clock_enable(image.clkoe);
+                flush();
+
+                if (was_enabled && enable)
+                {
+                    dark_window_us_ = static_cast<uint32_t>(time_us_64() - dark_start_us);
+                }
+            }
+        }
+        active_pll_ = image.pll;
+
+        commit_clock_enable(image.clkoe);
+        flush();
+
+        current_state_.frequency = image.frequency;
+        current_state_.enable = enable;
+        commit_us_ = static_cast<uint32_t>(time_us_64() - start_us);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        busy_ = false;
     }
 
-private:
+    /**
+     * @brief  Return true while apply() is writing to the chip.
+     * 
+     * @note   Lets an interrupt handler that wants to apply an image
+     *         tell whether it has interrupted another apply().
+     */
+    auto is_busy() -> bool
+    {
+        return busy_;
+    }
 
     /**
-     * @brief  Set the flag to enable/disable the clock.
-     * @param  enable  Enable clock if true, false otherwise.
+     * @brief  Return the latency stamps of the commits since they were
+     *         last cleared.
      */
-    auto commit_disable_clock() -> void
+    auto stamps() -> latency::Stamps&
     {
-        commit_clock_enable(NONE);
+        return stamps_;
+    }
+
+    /**
+     * @brief  Return the bus the chip is on.
+     */
+    auto bus() -> Bus&
+    {
+        return bus_;
     }
 
+private:
+
     /**
      * @brief  Set the flag to enable/disable the clock.
      * @param  enable  Enable clock if true, false otherwise.
      */
-    auto commit_enable_clock() -> void
+    auto commit_disable_clock() -> void
     {
-        commit_clock_enable(CLOCK2);
+        commit_clock_enable(NONE);
     }
 
     /**
@@ -139,139 +348,90 @@ private:
         //
         if (clock_mask != 0x00)
         {
-            // Indices into the array containing values to be written
-            // to the registers.
-            //
-            const int reg44 = 0;
-            const int reg45 = 1;
-            const int reg46 = 2;
-
-            uint8_t regs[3] = {0x00, 0x00, 0x00 };
-            if ((clock_mask & 0x01) == 0x01)
-            {
-                regs[reg44] |= 0x20;
-            }
-            if ((clock_mask & 0x02) == 0x02)
-            {
-                regs[reg44] |= 0x04;
-            }
-            if ((clock_mask & 0x04) == 0x04)
-            {
-                regs[reg45] |= 0x80;
-            }
-            if ((clock_mask & 0x08) == 0x08)
-            {
-                regs[reg45] |= 0x10;
-            }
-            regs[reg46] = 0x3F;
-
-            // Write to the registers.
-            //
-            write_reg(REG44, regs[reg44]);
-            write_reg(REG45, regs[reg45]);
-            write_reg(REG46, regs[reg46]);
+            commit_crosspoint(clock_mask);
         }
-        write_reg(CLKOE, clock_mask);
+        stage_reg(CLKOE, clock_mask);
     }
 
     /**
-     * @brief  Calculate constants and set the clock frequency.
-     * 
-     * @param  frequency_hz  Desire clock frequency, in Hz
+     * @brief  Route the VCO divider to the selected clocks.
+     * @param  clock_mask  Mask identifying the clocks to be enabled.
      * 
-     * @return Actual programmed frequency.
+     * @note   Only clocks 1 - 4.
      */
-    auto frequency_commit(float frequency_hz) -> float
-    {  
-        float q_min = 2; 
-        float q_max = (int)(clock_freq_hz_ / 250000.0);
-        if (q_max > 127.0) { q_max = 127.0; }
-
-        float d_min = (int)(1.0 + 100000000.0 / frequency_hz); 
-        float d_max = (int)(1.0 + 400000000.0 / frequency_hz) - 1.0;
-        if (d_max > 127.0) { d_max = 127.0; }
-
-        float p_min = 16.0;
-        float p_max = 1023.0;
-
-        float f_test, f_diff; 
-        float f_track = frequency_hz; 
-        float p_test, q_test, d_test; 
-        
-        uint16_t p, q, d; 
-        for (q_test = q_min; (q_test <= q_max) && (f_track > 0.5); q_test++) 
-        { 
-            for (d_test = d_max; (d_test >= d_min) && (f_track > 0.5); d_test--) 
-            { 
-                // Calculating the p value.  It has to fall between 16 and 1023.
-                // If the calculated value does not fall in that range, just
-                // bound it.
-                //
-                p_test = (frequency_hz / clock_freq_hz_) * q_test * d_test; 
-                p_test = ((p_test - (int)p_test) > .5) ? (int)(p_test + 1.0) : (int)p_test;
-                if (p_test < p_min)
-                    p_test = p_min;
-                else if (p_test > p_max)
-                    p_test = p_max;
-
-                // Now calculate the prorammed frequency and see if it's
-                // a better fit that the previous.
-                //
-                f_test = (clock_freq_hz_ * p_test) / (q_test * d_test); 
-                f_diff = ((f_test - frequency_hz) > 0.0) ? (f_test - frequency_hz) : (frequency_hz - f_test); 
-                if (f_diff < f_track) 
-                { 
-                    f_track = f_diff; 
-                    p = static_cast<uint16_t>(p_test); 
-                    q = static_cast<uint16_t>(q_test); 
-                    d = static_cast<uint16_t>(d_test); 
-                } 
-            } 
+    auto commit_crosspoint(uint8_t clock_mask) -> void
+    {
+        // Indices into the array containing values to be written
+        // to the registers.
+        //
+        const int reg44 = 0;
+        const int reg45 = 1;
+        const int reg46 = 2;
+
+        uint8_t regs[3] = {0x00, 0x00, 0x00 };
+        if ((clock_mask & 0x01) == 0x01)
+        {
+            regs[reg44] |= 0x20;
+        }
+        if ((clock_mask & 0x02) == 0x02)
+        {
+            regs[reg44] |= 0x04;
+        }
+        if ((clock_mask & 0x04) == 0x04)
+        {
+            regs[reg45] |= 0x80;
         }
-        return frequency_commit(q, p, d);
+        if ((clock_mask & 0x08) == 0x08)
+        {
+            regs[reg45] |= 0x10;
+        }
+        regs[reg46] = 0x3F;
+
+        // Write to the registers.  The crosspoint has to be in
+        // place before the output is turned on.
+        //
+        stage_reg(REG44, regs[reg44]);
+        stage_reg(REG45, regs[reg45]);
+        stage_reg(REG46, regs[reg46]);
+        flush();
     }
 
     /**
-     * @brief  Sets the clock frequency according to the constraints
-     *         listed in the datasheet.
+     * @brief  Works out the PLL register values according to the 
+     *         constraints listed in the datasheet.
      * 
      * @param  q_total  Value for the q counter (2 - 129)
      * @param  p_total  Value for the p counter (8 - 2055)
+     * @param  divider  Value for the output divider (4 - 127)
      * 
-     * @return Actual programmed frequency.
+     * @return Register image with the output disabled.
      */
-    auto frequency_commit(uint16_t q_total, uint16_t p_total, uint16_t divider) -> float
+    auto encode(uint16_t q_total, uint16_t p_total, uint16_t divider) -> register_image_t
     {
         // Set the q counter value.
         //
-        float q_total_f   = static_cast<float>(q_total);
-        float q_total_max = static_cast<uint8_t>(clock_freq_hz_ / 250000.0);
+        uint64_t q_total_max = clock_freq_ / PllSolver::PFD_MIN_MILLIHZ;
         
-        if (q_total_f > q_total_max)
-            q_total_f = q_total_max;
-        if (q_total_f < 2.0)
-            q_total_f = 2.0;
-        if (q_total_f > 129.0)
-            q_total_f = 129;
-
-        q_total = 1 + static_cast<uint16_t>(q_total_f - 1.0);
+        if (q_total > q_total_max)
+            q_total = static_cast<uint16_t>(q_total_max);
+        if (q_total < 2)
+            q_total = 2;
+        if (q_total > 129)
+            q_total = 129;
 
         // Set the p counter values.
         //       
-        float p_total_f   = static_cast<float>(p_total);
-        float p_total_max = (400000000.0 / clock_freq_hz_) * q_total; 
-        float p_total_min = (100000000.0 / clock_freq_hz_) * q_total;
-
-        if (p_total_f > p_total_max)
-            p_total_f = p_total_max;
-        if (p_total_f < p_total_min)
-            p_total_f = p_total_min;
-        if (p_total_f > 1023.0)     // 2055
-            p_total_f = 1023.0;     // 2055
-        if (p_total_f < 16.0)       // 8
-            p_total_f = 16.0;       // 8
-
-        p_total = 1 + static_cast<uint16_t>(p_total_f - 1.0);
+        uint64_t p_total_max = (PllSolver::VCO_MAX_MILLIHZ * q_total) / clock_freq_; 
+        uint64_t p_total_min = (PllSolver::VCO_MIN_MILLIHZ * q_total + clock_freq_ - 1) / clock_freq_;
+
+        if (p_total > p_total_max)
+            p_total = static_cast<uint16_t>(p_total_max);
+        if (p_total < p_total_min)
+            p_total = static_cast<uint16_t>(p_total_min);
+        if (p_total > 1023)     // 2055
+            p_total = 1023;     // 2055
+        if (p_total < 16)       // 8
+            p_total = 16;       // 8
 
         // Set the divider value.
         //
@@ -288,63 +448,155 @@ private:
                      (p_total < 800) ? 0x03 :
                       0x04;
     
-        // Write vlaues to the registers.
+        // Work out the register values.
         //
         uint8_t  po = p_total % 2;
         uint16_t pb = ((p_total - po) / 2) - 4;
         uint8_t  q  = (q_total - 2);
 
-        uint8_t reg40 = 0xC0 | (cp << 2) | static_cast<uint8_t>(pb >> 8);
-        uint8_t reg41 = static_cast<uint8_t>(pb & 0x00FF);
-        uint8_t reg42 = (po << 7) | q;
-        uint8_t dvdr  = 0x00 | static_cast<uint8_t>(divider);
-
-        write_reg(REG40, reg40);
-        write_reg(REG41, reg41);
-        write_reg(REG42, reg42);
-        write_reg(DVDR,  dvdr);
+        register_image_t image {};
+        image.pll   = { p_total, q_total, divider };
+        image.reg40 = 0xC0 | (cp << 2) | static_cast<uint8_t>(pb >> 8);
+        image.reg41 = static_cast<uint8_t>(pb & 0x00FF);
+        image.reg42 = (po << 7) | q;
+        image.dvdr  = 0x00 | static_cast<uint8_t>(divider);
+        image.clkoe = NONE;
 
-        // Return the actual programmed frequency.
+        // Actual programmed frequency, rounded to the nearest mHz.
         //
-        float numer = (clock_freq_hz_ * static_cast<float>(p_total));
-        float denom = (static_cast<float>(q_total) * static_cast<float>(divider));
-        float frequency = numer / denom;
-        return frequency;
+        uint64_t numer = clock_freq_ * p_total;
+        uint64_t denom = static_cast<uint64_t>(q_total) * divider;
+        image.frequency = (numer + denom / 2) / denom;
+        return image;
     }
 
     /**
-     * @brief  Write to an 8 bit register.
+     * @brief  Stage a write to an 8 bit register.
      * 
      * @param  address  Register address to which to write.
      * @param  value    Value to be written.
+     * 
+     * @note   Only the shadow copy is updated.  The register is marked
+     *         dirty if the chip doesn't already hold the value, and is
+     *         sent by the next flush().
+     */
+    auto stage_reg(uint8_t address, uint8_t value) -> void
+    {
+        if (!valid_[address] || (shadow_[address] != value))
+        {
+            shadow_[address] = value;
+            valid_[address] = true;
+            dirty_[address] = true;
+        }
+    }
+
+    /**
+     * @brief  Return true if a PLL change is small enough to make with
+     *         the output left on.
+     * @param  pll  PLL settings being changed to.
+     * 
+     * @note   A divider-only change leaves the VCO alone.  A small
+     *         P-only change nudges the VCO without losing lock.
      */
-    void write_reg(uint16_t address, uint8_t value)
+    auto pll_step_is_hitless(PllSolver::pll_settings_t const& pll) -> bool
     {
-        uint8_t data[2];
+        if ((pll.q != active_pll_.q) || (active_pll_.p == 0))
+            return false;
 
-        // Need to make sure the address is big-endian.
-        //
-        data[0] = address & 0x00FF;
-        data[1] = value;
+        if (pll.p == active_pll_.p)
+            return true;
+
+        if (pll.d != active_pll_.d)
+            return false;
+
+        uint16_t p_step = (pll.p > active_pll_.p) ?
+            (pll.p - active_pll_.p) : (active_pll_.p - pll.p);
+        return (p_step * HITLESS_P_STEP) <= active_pll_.p;
+    }
 
-        i2c_write_blocking(i2c_, I2C_ADDRESS, data, sizeof(data), false);
+    /**
+     * @brief  Return true if any of the PLL registers are dirty.
+     */
+    auto pll_is_dirty() -> bool
+    {
+        return dirty_[REG40] || dirty_[REG41] || dirty_[REG42] || dirty_[DVDR];
+    }
+
+    /**
+     * @brief  Send all dirty registers to the chip.
+     * 
+     * @note   Registers are sent in address order.  Runs of contiguous
+     *         dirty registers go out as a single auto-increment block 
+     *         write rather than one transaction per register.
+     */
+    auto flush() -> void
+    {
+        uint8_t address = 0;
+        while (address < REG_COUNT)
+        {
+            if (!dirty_[address])
+            {
+                address++;
+                continue;
+            }
+
+            uint8_t length = 1;
+            while (((address + length) < REG_COUNT) && dirty_[address + length])
+                length++;
+
+            write_block(address, length);
+            address += length;
+        }
+    }
+
+    /**
+     * @brief  Write a run of registers from the shadow copy.
+     * 
+     * @param  address  First register address to which to write.
+     * @param  length   Number of registers to write.
+     * 
+     * @note   Registers stay dirty if the write fails so the next
+     *         flush() retries them.
+     */
+    auto write_block(uint8_t address, uint8_t length) -> void
+    {
+        uint8_t data[REG_COUNT + 1];
+
+        data[0] = address;
+        for (uint8_t i = 0; i < length; i++)
+            data[i + 1] = shadow_[address + i];
+
+        if (bus_.write(I2C_ADDRESS, data, length + 1))
+        {
+            for (uint8_t i = 0; i < length; i++)
+                dirty_[address + i] = false;
+        }
     }
 
     // Register definitions.
     //
-    static const uint16_t CLKOE = 0x09;
-    static const uint16_t DVDR  = 0x0C;
-    static const uint16_t XDRV  = 0x12;
-
-    static const uint16_t REG09 = 0x09;
-    static const uint16_t REG0C = 0x0C;
-    static const uint16_t REG12 = 0x12;
-    static const uint16_t REG40 = 0x40;
-    static const uint16_t REG41 = 0x41;
-    static const uint16_t REG42 = 0x42;
-    static const uint16_t REG44 = 0x44;
-    static const uint16_t REG45 = 0x45;
-    static const uint16_t REG46 = 0x46;
+    static const uint8_t CLKOE = 0x09;
+    static const uint8_t DVDR  = 0x0C;
+    static const uint8_t XDRV  = 0x12;
+
+    static const uint8_t REG09 = 0x09;
+    static const uint8_t REG0C = 0x0C;
+    static const uint8_t REG12 = 0x12;
+    static const uint8_t REG40 = 0x40;
+    static const uint8_t REG41 = 0x41;
+    static const uint8_t REG42 = 0x42;
+    static const uint8_t REG44 = 0x44;
+    static const uint8_t REG45 = 0x45;
+    static const uint8_t REG46 = 0x46;
+
+    // Size of the shadow register file.  Covers every register
+    // the driver touches.
+    //
+    static const uint8_t REG_COUNT = 0x48;
+
+    // Largest P-only step taken hitlessly, as a fraction of P.
+    //
+    static const uint16_t HITLESS_P_STEP = 32;
 
     static const uint8_t NONE   = 0x00;
     static const uint8_t CLOCK2 = 0x02;
@@ -352,17 +604,59 @@ private:
     static const bool ENABLE  = true;
     static const bool DISABLE = false;
 
-    i2c_inst_t* i2c_;
-    float clock_freq_hz_;
+    Bus bus_;
+    millihertz_t clock_freq_;
+    PllSolver solver_;
 
     // State definitions.
     //
     using cy22150_state = struct {
-        float frequency;
+        millihertz_t frequency;
         bool enable;
     };
     
+    // Changes waiting for the next commit.
+    //
+    using cy22150_changes = struct {
+        std::optional<millihertz_t> frequency;
+        std::optional<bool> enable;
+    };
+
     cy22150_state current_state_;
-    cy22150_state temp_state_;
+    cy22150_changes temp_state_;
     cy22150_state default_state_;
-};
\ No newline at end of file
+
+    // Set while apply() is running.
+    //
+    volatile bool busy_ = false;
+
+    // Hitless retune state.  The PLL settings are those last
+    // committed to the chip.
+    //
+    bool hitless_ = false;
+    uint32_t dark_window_us_ = 0;
+    uint32_t commit_us_ = 0;
+    PllSolver::pll_settings_t active_pll_ { 0, 0, 0 };
+
+    // Latency stamps of the last commit.  Empty unless latency stats
+    // are built in.
+    //
+    [[no_unique_address]] latency::Stamps stamps_;
+
+    // Shadow copy of the chip registers.  A register is valid once
+    // it has been written and dirty until the write reaches the chip.
+    //
+    std::array<uint8_t, REG_COUNT> shadow_ {};
+    std::bitset<REG_COUNT> valid_ {};
+    std::bitset<REG_COUNT> dirty_ {};
+};
+
+#if __has_include("hardware/i2c.h")
+#include "pico_i2c_bus.hpp"
+
+// The chip as the firmware sees it, on the Pico's I2C hardware.  Left
+// out of builds with no I2C, such as the host benchmarks.  The
+// simulator has an I2C stand-in, so it gets it too.
+//
+using CY22150 = CY22150Driver<PicoI2cBus>;
+#endif
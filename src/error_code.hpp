@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief  Errors reported back to the host.
+ *
+ * @note   Everything between receiving a command and replying to it
+ *         passes errors around as one of these codes.  The text sent
+ *         with the reply comes from a constexpr table, so reporting
+ *         an error never builds a string or touches the heap.
+ *
+ * @note   The text is part of the protocol.  Don't reword it, and
+ *         keep the table in the same order as the codes.
+ */
+enum class error_code_t : uint8_t {
+    // Receiving and parsing commands.
+    //
+    COMMAND_TOO_LONG,
+    JSON_INVALID,
+    BATCH_EMPTY,
+    BATCH_TOO_LARGE,
+    BATCH_FLAG,
+    COMMAND_NUMBER,
+    PIPELINING_SETTINGS,
+    ENABLE_FLAG,
+    HITLESS_FLAG,
+    MACHINE_FLAG,
+    COALESCE_FLAG,
+    FREQUENCY,
+    SWEEP_FREQUENCY,
+    SWEEP_SETTINGS,
+    HOP_SETTINGS,
+    TRIGGER_SETTINGS,
+    APPLY_TIME,
+    FREQUENCIES,
+    FREQUENCIES_HELD,
+    BINARY_FRAME,
+    BINARY_CRC,
+    BINARY_HEADER,
+    BINARY_FIELDS,
+
+    // Dispatching commands.
+    //
+    UNKNOWN_COMMAND,
+    NOT_SCHEDULABLE,
+    NOT_BATCHABLE,
+    BATCH_APPLY_TIMES,
+    BATCH_NOT_APPLIED,
+    HOP_INDEX_REQUIRED,
+    TRIGGER_GPIO_REQUIRED,
+    MODE_FLAG_REQUIRED,
+    LATENCY_DISABLED,
+
+    // Running commands.
+    //
+    HOP_TABLE_GAP,
+    HOP_TABLE_FULL,
+    HOP_INDEX_RANGE,
+    HOP_TABLE_EMPTY,
+    HOP_TABLE_ARMED,
+    SCHEDULE_FULL,
+    SWEEP_LIMITS_REQUIRED,
+    SWEEP_STEP_REQUIRED,
+    SWEEP_STEP_PPM,
+    SWEEP_DWELL,
+    SWEEP_TIMER,
+    TRIGGER_GPIO,
+
+    COUNT
+};
+
+namespace error_code
+{
+    // Text of each error, indexed by code.
+    //
+    constexpr char const* MESSAGES[] = {
+        "Command is too long.",
+        "Error creating json from command buffer",
+        "Batch is empty.",
+        "Batch is too large.",
+        "Error parsing batch flag.",
+        "Error parsing command number",
+        "Error parsing pipelining settings.",
+        "Error parsing enable flag.",
+        "Error parsing hitless flag.",
+        "Error parsing machine flag.",
+        "Error parsing coalesce flag.",
+        "Error parsing frequency.",
+        "Error parsing sweep frequency.",
+        "Error parsing sweep settings.",
+        "Error parsing hop settings.",
+        "Error parsing trigger settings.",
+        "Error parsing apply time.",
+        "Error parsing frequencies.",
+        "Frequencies are already waiting to be loaded.",
+        "Error decoding binary frame.",
+        "Binary frame CRC error.",
+        "Error parsing binary command header.",
+        "Error parsing binary command fields.",
+
+        "Unknown command number.",
+        "Command can't be scheduled.",
+        "Command can't be batched.",
+        "Batch apply times differ.",
+        "Batch not applied.",
+        "Hop index is required.",
+        "Trigger gpio is required.",
+        "Machine or coalesce flag is required.",
+        "Latency stats are not built in.",
+
+        "Hop table offset leaves a gap.",
+        "Hop table is full.",
+        "Hop index is past the end of the table.",
+        "Hop table is empty.",
+        "Hop table can't be loaded while the trigger is armed.",
+        "Schedule is full.",
+        "Sweep start and stop are required.",
+        "Sweep step or step_ppm is required.",
+        "Sweep step_ppm is too large.",
+        "Sweep dwell_us is too short.",
+        "No timer available for sweep.",
+        "Trigger GPIO is not available.",
+    };
+
+    static_assert(sizeof(MESSAGES) / sizeof(MESSAGES[0]) == static_cast<size_t>(error_code_t::COUNT),
+                  "Every error code needs a message");
+
+    /**
+     * @brief  Return the text sent for an error.
+     * @param  code  Error to look up.
+     */
+    constexpr auto message(error_code_t code) -> char const*
+    {
+        return MESSAGES[static_cast<size_t>(code)];
+    }
+}
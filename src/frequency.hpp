@@ -0,0 +1,208 @@
+#pragma once
+
+#include <optional>
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief  Fixed point frequency handling.
+ *
+ * @note   Frequencies are carried end to end as unsigned 64 bit
+ *         millihertz.  A float only has a 24 bit mantissa so it can't
+ *         hold integer Hz above 16.7 MHz, and the RP2040 has no FPU
+ *         so every float operation is a library call anyway.
+ */
+using millihertz_t = uint64_t;
+
+namespace frequency
+{
+    static constexpr millihertz_t MILLIHZ_PER_HZ = 1000;
+
+    // Largest frequency accepted from the outside world.  Anything
+    // bigger than this is far outside what the chip can produce and
+    // keeps the solver arithmetic well clear of overflow.
+    //
+    static constexpr millihertz_t MAX_MILLIHZ = 1000000000000000ULL;
+
+    // Buffer size needed by format(), including the terminator.
+    //
+    static constexpr size_t FORMAT_LEN = 24;
+
+    /**
+     * @brief  Convert whole Hz to millihertz.
+     * @param  hz  Frequency, in Hz.
+     */
+    constexpr auto from_hz(uint64_t hz) -> millihertz_t
+    {
+        return hz * MILLIHZ_PER_HZ;
+    }
+
+    /**
+     * @brief  Convert millihertz to whole Hz, rounding to nearest.
+     * @param  frequency  Frequency, in mHz.
+     */
+    constexpr auto to_hz(millihertz_t frequency) -> uint64_t
+    {
+        return (frequency + MILLIHZ_PER_HZ / 2) / MILLIHZ_PER_HZ;
+    }
+
+    /**
+     * @brief  Parse a JSON number, in Hz, into millihertz.
+     *
+     * @param  text  Null terminated JSON integer or real.
+     *
+     * @return The frequency, or nullopt if the text isn't a
+     *         non-negative number or is out of range.
+     *
+     * @note   Digits past the third decimal place are rounded.
+     *         Parsing is done with integer math only.
+     */
+    inline auto parse(char const* text) -> std::optional<millihertz_t>
+    {
+        if (!text)
+            return std::nullopt;
+
+        // Collect the significant digits as one integer, remembering
+        // how many of them were after the decimal point.
+        //
+        uint64_t mantissa = 0;
+        int scale = 0;
+        int digits = 0;
+        bool seen_point = false;
+
+        char const* ptr = text;
+        if (*ptr == '+')
+            ptr++;
+
+        for (; *ptr != '\0'; ptr++)
+        {
+            if ((*ptr >= '0') && (*ptr <= '9'))
+            {
+                uint8_t digit = static_cast<uint8_t>(*ptr - '0');
+                digits++;
+                if (mantissa < 100000000000000000ULL)
+                {
+                    mantissa = mantissa * 10 + digit;
+                    if (seen_point) { scale--; }
+                }
+                else
+                {
+                    // Out of precision.  Just keep track of the
+                    // magnitude.
+                    //
+                    if (!seen_point) { scale++; }
+                }
+            }
+            else if ((*ptr == '.') && !seen_point)
+            {
+                seen_point = true;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (digits == 0)
+            return std::nullopt;
+
+        // Optional exponent.
+        //
+        if ((*ptr == 'e') || (*ptr == 'E'))
+        {
+            ptr++;
+            bool negative = false;
+            if ((*ptr == '+') || (*ptr == '-'))
+            {
+                negative = (*ptr == '-');
+                ptr++;
+            }
+            if ((*ptr < '0') || (*ptr > '9'))
+                return std::nullopt;
+
+            int exponent = 0;
+            for (; (*ptr >= '0') && (*ptr <= '9'); ptr++)
+            {
+                if (exponent < 1000) { exponent = exponent * 10 + (*ptr - '0'); }
+            }
+            scale += negative ? -exponent : exponent;
+        }
+
+        if (*ptr != '\0')
+            return std::nullopt;
+
+        // Scale from Hz to millihertz.
+        //
+        scale += 3;
+        uint64_t value = mantissa;
+        if (scale >= 0)
+        {
+            for (; scale > 0; scale--)
+            {
+                if (value > MAX_MILLIHZ / 10)
+                    return std::nullopt;
+                value *= 10;
+            }
+        }
+        else
+        {
+            bool round_up = false;
+            for (; scale < 0; scale++)
+            {
+                round_up = (value % 10) >= 5;
+                value /= 10;
+            }
+            if (round_up) { value++; }
+        }
+
+        if (value > MAX_MILLIHZ)
+            return std::nullopt;
+
+        return value;
+    }
+
+    /**
+     * @brief  Format a frequency, in Hz, as a JSON number.
+     *
+     * @param  frequency  Frequency, in mHz.
+     * @param  buffer     Destination, at least FORMAT_LEN characters.
+     *
+     * @return Pointer to the null terminated text within buffer.
+     *
+     * @note   Whole Hz values are written without a decimal point so
+     *         existing clients keep seeing integers.
+     */
+    inline auto format(millihertz_t frequency, char* buffer) -> char const*
+    {
+        char* ptr = buffer + FORMAT_LEN - 1;
+        *ptr = '\0';
+
+        uint64_t hz = frequency / MILLIHZ_PER_HZ;
+        uint32_t fraction = static_cast<uint32_t>(frequency % MILLIHZ_PER_HZ);
+
+        if (fraction != 0)
+        {
+            int places = 3;
+            while ((fraction % 10) == 0)
+            {
+                fraction /= 10;
+                places--;
+            }
+            for (; places > 0; places--)
+            {
+                *--ptr = static_cast<char>('0' + (fraction % 10));
+                fraction /= 10;
+            }
+            *--ptr = '.';
+        }
+
+        do
+        {
+            *--ptr = static_cast<char>('0' + (hz % 10));
+            hz /= 10;
+        } while (hz != 0);
+
+        return ptr;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <optional>
+
+#include "cy22150.hpp"
+#include "error_code.hpp"
+#include "frequency.hpp"
+
+/**
+ * @brief  Table of pre-solved frequencies to hop between.
+ *
+ * @note   Each frequency is run through the solver once, when it's
+ *         loaded, and kept as a register image.  A hop then only has
+ *         to write the stored registers.
+ */
+class HopTable
+{
+public:
+
+    static const uint32_t MAX_HOPS = 256;
+
+    /**
+     * @brief  Constructor
+     * @param  dds  Clock generator the table is applied to.
+     */
+    HopTable(CY22150& dds)
+        :dds_(dds)
+    { };
+
+    /**
+     * @brief  Load part of the table.
+     *
+     * @param  offset       Index of the first entry to load.
+     * @param  frequencies  Frequencies to load, in mHz.
+     * @param  count        Number of frequencies.
+     * @param  enable       Output enable to store with each entry.
+     *
+     * @return Error if the entries don't fit, nullopt otherwise.
+     *
+     * @note   The table ends after the last entry loaded, so large
+     *         tables are loaded in order starting from offset 0.
+     */
+    auto load(uint32_t offset, millihertz_t const* frequencies, size_t count, bool enable) -> std::optional<error_code_t>
+    {
+        if (offset > count_)
+            return std::make_optional(error_code_t::HOP_TABLE_GAP);
+        if ((offset + count) > MAX_HOPS)
+            return std::make_optional(error_code_t::HOP_TABLE_FULL);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            table_[offset + i] = dds_.solve(frequencies[i], enable);
+        }
+        count_ = offset + static_cast<uint32_t>(count);
+
+        return std::nullopt;
+    }
+
+    /**
+     * @brief  Hop to a table entry.
+     * @param  index  Index of the entry.
+     * @return Error if there's no such entry, nullopt otherwise.
+     *
+     * @note   Safe to call from interrupt context with a valid index.
+     */
+    auto hop(uint32_t index) -> std::optional<error_code_t>
+    {
+        if (index >= count_)
+            return std::make_optional(error_code_t::HOP_INDEX_RANGE);
+
+        dds_.apply(table_[index]);
+        index_ = index;
+
+        return std::nullopt;
+    }
+
+    /**
+     * @brief  Return the number of entries in the table.
+     */
+    auto size() -> uint32_t
+    {
+        return count_;
+    }
+
+    /**
+     * @brief  Return the index of the last entry hopped to.
+     */
+    auto get_index() -> uint32_t
+    {
+        return index_;
+    }
+
+private:
+
+    CY22150& dds_;
+
+    std::array<CY22150::register_image_t, MAX_HOPS> table_ {};
+    uint32_t count_ = 0;
+    uint32_t index_ = 0;
+};
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <array>
+#include <optional>
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frequency.hpp"
+#include "tiny-json.h"
+
+/**
+ * @brief  Maps JSON properties onto the members of a struct.
+ *
+ * @note   A schema is a table of the property names a struct accepts,
+ *         each with the function that checks the type of a property
+ *         and stores it in the right member.  The table is turned
+ *         into a perfect hash at compile time, so looking up a
+ *         property costs one hash of its name and one strcmp however
+ *         many fields there are.  Adding a field only adds a table
+ *         entry.
+ */
+namespace json_schema
+{
+    /**
+     * @brief  Parse a boolean property.
+     * @param  type   Type of the property.
+     * @param  text   Text of the property.
+     * @param  value  Set to the value.
+     * @return false if the property isn't a boolean.
+     */
+    inline auto parse_boolean(jsonType_t type, char const* text, std::optional<bool>& value) -> bool
+    {
+        if (JSON_BOOLEAN != type)
+            return false;
+
+        value = std::make_optional(*text == 't');
+        return true;
+    }
+
+    /**
+     * @brief  Convert the text of an integer property.
+     * @param  text   Text of the property.
+     * @param  value  Set to the value.
+     * @return false if the value doesn't fit in 64 bits.
+     *
+     * @note   strtoll() saturates on overflow, so errno is the only
+     *         way to tell a huge value from INT64_MAX.
+     */
+    inline auto to_integer(char const* text, int64_t& value) -> bool
+    {
+        errno = 0;
+        value = strtoll(text, nullptr, 10);
+        return errno != ERANGE;
+    }
+
+    /**
+     * @brief  Parse an integer property that has to be there.
+     * @param  type   Type of the property.
+     * @param  text   Text of the property.
+     * @param  value  Set to the value.
+     * @return false if the property isn't an integer.
+     */
+    inline auto parse_integer(jsonType_t type, char const* text, int& value) -> bool
+    {
+        int64_t integer = 0;
+        if ((JSON_INTEGER != type) || !to_integer(text, integer))
+            return false;
+
+        value = static_cast<uint32_t>(integer);
+        return true;
+    }
+
+    /**
+     * @brief  Parse an unsigned 32 bit integer property.
+     * @param  type   Type of the property.
+     * @param  text   Text of the property.
+     * @param  value  Set to the value.
+     * @return false if the property isn't an integer in range.
+     */
+    inline auto parse_integer(jsonType_t type, char const* text, std::optional<uint32_t>& value) -> bool
+    {
+        int64_t integer = 0;
+        if ((JSON_INTEGER != type) || !to_integer(text, integer))
+            return false;
+
+        if ((integer < 0) || (integer > UINT32_MAX))
+            return false;
+
+        value = std::make_optional(static_cast<uint32_t>(integer));
+        return true;
+    }
+
+    /**
+     * @brief  Parse an unsigned 64 bit integer property.
+     * @param  type   Type of the property.
+     * @param  text   Text of the property.
+     * @param  value  Set to the value.
+     * @return false if the property isn't a non-negative integer.
+     */
+    inline auto parse_integer(jsonType_t type, char const* text, std::optional<uint64_t>& value) -> bool
+    {
+        int64_t integer = 0;
+        if ((JSON_INTEGER != type) || !to_integer(text, integer))
+            return false;
+
+        if (integer < 0)
+            return false;
+
+        value = std::make_optional(static_cast<uint64_t>(integer));
+        return true;
+    }
+
+    /**
+     * @brief  Parse a frequency property.
+     * @param  type   Type of the property.
+     * @param  text   Text of the property.
+     * @param  value  Set to the value, in mHz.
+     * @return false if the property isn't a valid frequency.
+     *
+     * @note   Frequencies are given in Hz and may be fractional, so
+     *         reals are accepted as well as integers.  The text is
+     *         converted straight to millihertz to stay clear of float.
+     */
+    inline auto parse_frequency(jsonType_t type, char const* text, std::optional<millihertz_t>& value) -> bool
+    {
+        if ((JSON_INTEGER != type) && (JSON_REAL != type))
+            return false;
+
+        value = frequency::parse(text);
+        return value.has_value();
+    }
+
+    // Finds the struct a member pointer belongs to.
+    //
+    template <typename T>
+    struct member_traits;
+
+    template <typename Record, typename Value>
+    struct member_traits<Value Record::*>
+    {
+        using record_t = Record;
+    };
+
+    template <auto Member>
+    using record_of = typename member_traits<decltype(Member)>::record_t;
+
+    // Checks a property and stores it in a struct.  The text is
+    // nullptr when the property is an object or an array.
+    //
+    template <typename Record>
+    using setter_t = bool (*)(Record& record, jsonType_t type, char const* text);
+
+    /**
+     * @brief  Setter for a boolean member.
+     */
+    template <auto Member>
+    auto boolean(record_of<Member>& record, jsonType_t type, char const* text) -> bool
+    {
+        return parse_boolean(type, text, record.*Member);
+    }
+
+    /**
+     * @brief  Setter for an integer member.
+     */
+    template <auto Member>
+    auto integer(record_of<Member>& record, jsonType_t type, char const* text) -> bool
+    {
+        return parse_integer(type, text, record.*Member);
+    }
+
+    /**
+     * @brief  Setter for a frequency member.
+     */
+    template <auto Member>
+    auto frequency(record_of<Member>& record, jsonType_t type, char const* text) -> bool
+    {
+        return parse_frequency(type, text, record.*Member);
+    }
+
+    /**
+     * @brief  Setter for an array of frequencies.  Only accepts the
+     *         start of an array, and empties it ready for the entries.
+     *
+     * @note   The entries go in a buffer the member points to, which
+     *         is nullptr if there's nowhere to put them.
+     */
+    template <auto Array, auto Count>
+    auto frequencies(record_of<Count>& record, jsonType_t type, char const*) -> bool
+    {
+        record.*Count = 0;
+        return (JSON_ARRAY == type) && (record.*Array != nullptr);
+    }
+
+    /**
+     * @brief  Setter for one entry of an array of frequencies.
+     */
+    template <auto Array, auto Count, size_t Capacity>
+    auto frequency_entry(record_of<Array>& record, jsonType_t type, char const* text) -> bool
+    {
+        std::optional<millihertz_t> value = std::nullopt;
+        if (!parse_frequency(type, text, value) || ((record.*Count) >= Capacity))
+            return false;
+
+        (record.*Array)[(record.*Count)++] = value.value();
+        return true;
+    }
+
+    /**
+     * @brief  A property a struct accepts.
+     *
+     * @note   entry is only set for arrays, and is used for each entry
+     *         once set has accepted the start of the array.  error is
+     *         reported if either of them fails or, for a required
+     *         property, if it's missing.  It's whatever the caller
+     *         reports errors with.
+     */
+    template <typename Record, typename Error>
+    struct field_t
+    {
+        char const* name = nullptr;
+        setter_t<Record> set = nullptr;
+        setter_t<Record> entry = nullptr;
+        Error error {};
+        bool required = false;
+    };
+
+    /**
+     * @brief  Hash a property name.  FNV-1a, mixed with a seed so that
+     *         a seed can be picked that gives no collisions.
+     * @param  name  Null terminated name.
+     * @param  seed  Seed for the hash.
+     */
+    constexpr auto hash(char const* name, uint32_t seed) -> uint32_t
+    {
+        uint32_t value = 2166136261u ^ seed;
+        while (*name)
+        {
+            value ^= static_cast<uint8_t>(*name++);
+            value *= 16777619u;
+        }
+        return value ^ (value >> 15);
+    }
+
+    /**
+     * @brief  A set of properties, looked up through a perfect hash.
+     *
+     * @note   The constructor searches for a seed that puts every name
+     *         in a slot of its own.  It's meant to run at compile time
+     *         so the search never reaches the device; check
+     *         is_perfect() with a static_assert.
+     */
+    template <typename Record, typename Error, size_t N>
+    class Schema
+    {
+    public:
+
+        static_assert(N <= 32, "A schema can have at most 32 fields");
+
+        // Twice as many slots as fields keeps the seed search short.
+        //
+        static const size_t SLOTS = (N <= 8) ? 16 : (N <= 16) ? 32 : 64;
+        static const uint8_t EMPTY = 0xFF;
+        static const uint32_t MAX_SEED = 100000;
+
+        /**
+         * @brief  Constructor
+         * @param  fields  Properties the struct accepts.
+         */
+        constexpr Schema(field_t<Record, Error> const (&fields)[N])
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                fields_[i] = fields[i];
+                if (fields[i].required)
+                    required_ |= (1u << i);
+            }
+
+            for (seed_ = 0; seed_ < MAX_SEED; seed_++)
+            {
+                if (place())
+                    return;
+            }
+        }
+
+        /**
+         * @brief  Return true if a seed without collisions was found.
+         */
+        constexpr auto is_perfect() const -> bool
+        {
+            return seed_ < MAX_SEED;
+        }
+
+        /**
+         * @brief  Look up a property.
+         * @param  name  Name of the property.
+         * @return The field, or nullptr if the struct doesn't accept
+         *         the property.
+         */
+        auto find(char const* name) const -> field_t<Record, Error> const*
+        {
+            uint8_t slot = slots_[hash(name, seed_) & (SLOTS - 1)];
+            if ((slot == EMPTY) || (0 != strcmp(fields_[slot].name, name)))
+                return nullptr;
+            return &fields_[slot];
+        }
+
+        /**
+         * @brief  Return the bit for a field, for keeping track of
+         *         which fields have been seen.
+         * @param  field  Field returned by find().
+         */
+        auto bit(field_t<Record, Error> const* field) const -> uint32_t
+        {
+            return 1u << (field - fields_.data());
+        }
+
+        /**
+         * @brief  Find a required field that hasn't been seen.
+         * @param  seen  Bits of the fields that have been seen.
+         * @return The first required field missing, or nullptr if
+         *         there are none.
+         */
+        auto missing(uint32_t seen) const -> field_t<Record, Error> const*
+        {
+            uint32_t absent = required_ & ~seen;
+            for (size_t i = 0; i < N; i++)
+            {
+                if ((absent & (1u << i)) != 0)
+                    return &fields_[i];
+            }
+            return nullptr;
+        }
+
+    private:
+
+        /**
+         * @brief  Try to place every name with the current seed.
+         * @return false if two names land in the same slot.
+         */
+        constexpr auto place() -> bool
+        {
+            for (size_t i = 0; i < SLOTS; i++)
+                slots_[i] = EMPTY;
+
+            for (size_t i = 0; i < N; i++)
+            {
+                size_t slot = hash(fields_[i].name, seed_) & (SLOTS - 1);
+                if (slots_[slot] != EMPTY)
+                    return false;
+                slots_[slot] = static_cast<uint8_t>(i);
+            }
+            return true;
+        }
+
+        std::array<field_t<Record, Error>, N> fields_ {};
+        std::array<uint8_t, SLOTS> slots_ {};
+        uint32_t required_ = 0;
+        uint32_t seed_ = 0;
+    };
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "frequency.hpp"
+#include "tx_ring.hpp"
+
+/**
+ * @brief  Writes a single line JSON object straight into the transmit
+ *         ring.
+ *
+ * @note   There's no intermediate buffer and no iostreams.  Integers
+ *         are formatted two digits at a time, and 64 bit values are
+ *         split into 32 bit pieces first, so only one or two 64 bit
+ *         divisions are ever needed.
+ *
+ * @note   The layout matches what the firmware has always sent, two
+ *         spaces in front of each field and CR LF at the end.
+ */
+class JsonWriter
+{
+public:
+
+    /**
+     * @brief  Constructor.  Starts the object.
+     * @param  tx  Ring the object is written to.
+     */
+    JsonWriter(TxRing& tx)
+        :tx_(tx)
+    {
+        tx_.begin();
+        tx_.put('{');
+    }
+
+    /**
+     * @brief  Add an integer field.
+     * @param  name   Name of the field.
+     * @param  value  Value of the field.
+     */
+    auto field(char const* name, uint32_t value) -> JsonWriter&
+    {
+        key(name);
+        put_u32(value);
+        return *this;
+    }
+
+    /**
+     * @brief  Add a 64 bit integer field.
+     * @param  name   Name of the field.
+     * @param  value  Value of the field.
+     */
+    auto field(char const* name, uint64_t value) -> JsonWriter&
+    {
+        key(name);
+        put_u64(value);
+        return *this;
+    }
+
+    /**
+     * @brief  Add a signed integer field, such as a command number.
+     * @param  name   Name of the field.
+     * @param  value  Value of the field.
+     */
+    auto field(char const* name, int value) -> JsonWriter&
+    {
+        key(name);
+        if (value < 0)
+            tx_.put('-');
+        put_u32((value < 0) ? (0u - static_cast<uint32_t>(value)) : static_cast<uint32_t>(value));
+        return *this;
+    }
+
+    /**
+     * @brief  Add a boolean field.
+     * @param  name   Name of the field.
+     * @param  value  Value of the field.
+     */
+    auto field(char const* name, bool value) -> JsonWriter&
+    {
+        key(name);
+        tx_.put(value ? "true" : "false");
+        return *this;
+    }
+
+    /**
+     * @brief  Add a string field.
+     * @param  name  Name of the field.
+     * @param  text  Value of the field.  Quotes and backslashes are
+     *               escaped.
+     */
+    auto field(char const* name, char const* text) -> JsonWriter&
+    {
+        key(name);
+        tx_.put('"');
+        for (; *text; text++)
+        {
+            if ((*text == '"') || (*text == '\\'))
+                tx_.put('\\');
+            tx_.put(*text);
+        }
+        tx_.put('"');
+        return *this;
+    }
+
+    /**
+     * @brief  Add a frequency field, in Hz.
+     * @param  name   Name of the field.
+     * @param  value  Frequency, in mHz.
+     */
+    auto frequency(char const* name, millihertz_t value) -> JsonWriter&
+    {
+        char text[::frequency::FORMAT_LEN];
+
+        key(name);
+        tx_.put(::frequency::format(value, text));
+        return *this;
+    }
+
+    /**
+     * @brief  Finish the object and queue it for sending.
+     * @return false if the ring was full and the object was dropped.
+     */
+    auto end() -> bool
+    {
+        tx_.put("}\r\n");
+        return tx_.commit();
+    }
+
+private:
+
+    /**
+     * @brief  Write the separator and the name of a field.
+     * @param  name  Name of the field.
+     */
+    auto key(char const* name) -> void
+    {
+        if (!first_)
+            tx_.put(',');
+        first_ = false;
+
+        tx_.put("  \"");
+        tx_.put(name);
+        tx_.put("\":");
+    }
+
+    /**
+     * @brief  Write an unsigned 32 bit integer.
+     * @param  value  Integer to write.
+     */
+    auto put_u32(uint32_t value) -> void
+    {
+        char text[10];
+        char* ptr = text + sizeof(text);
+        while (value >= 100)
+        {
+            uint32_t pair = value % 100;
+            value /= 100;
+            ptr -= 2;
+            memcpy(ptr, &DIGIT_PAIRS[2 * pair], 2);
+        }
+        if (value >= 10)
+        {
+            ptr -= 2;
+            memcpy(ptr, &DIGIT_PAIRS[2 * value], 2);
+        }
+        else
+        {
+            *--ptr = static_cast<char>('0' + value);
+        }
+        tx_.put(ptr, static_cast<size_t>(text + sizeof(text) - ptr));
+    }
+
+    /**
+     * @brief  Write an unsigned 64 bit integer.
+     * @param  value  Integer to write.
+     */
+    auto put_u64(uint64_t value) -> void
+    {
+        if (value <= UINT32_MAX)
+        {
+            put_u32(static_cast<uint32_t>(value));
+            return;
+        }
+
+        // Peel off nine digits at a time, which always fit in 32 bits.
+        //
+        uint32_t low = static_cast<uint32_t>(value % BILLION);
+        put_u64(value / BILLION);
+
+        char text[9];
+        for (int i = 8; i >= 0; i--)
+        {
+            text[i] = static_cast<char>('0' + (low % 10));
+            low /= 10;
+        }
+        tx_.put(text, sizeof(text));
+    }
+
+    static constexpr uint32_t BILLION = 1000000000;
+
+    static constexpr char DIGIT_PAIRS[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    TxRing& tx_;
+    bool first_ = true;
+};
@@ -0,0 +1,448 @@
+#pragma once
+
+#include <array>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+// Per-command latency instrumentation is only built in when asked
+// for, with CY22150_LATENCY_STATS=1.  Otherwise every class here is
+// empty and every call compiles to nothing.
+//
+#ifndef CY22150_LATENCY_STATS
+#define CY22150_LATENCY_STATS 0
+#endif
+
+namespace latency
+{
+    static constexpr bool ENABLED = (CY22150_LATENCY_STATS != 0);
+
+    // Points in the life of a command that are timestamped.
+    //
+    enum stage_t : uint8_t {
+        RX_FIRST_BYTE,      // First byte of the line reached the receive ring
+        LINE_COMPLETE,      // Terminator framed by the main loop
+        PARSE_DONE,         // Command put on the fifo
+        DISPATCHED,         // Taken off the fifo, handed to the dispatcher
+        SOLVE_DONE,         // Register image worked out, writes starting
+        I2C_DONE,           // Last register write finished
+        ACK_QUEUED,         // Reply committed to the transmit ring
+        STAGE_COUNT
+    };
+
+    // Intervals that get a histogram.  Each stage after the first
+    // ends one, timed from the last stage before it that was stamped,
+    // so a query with no commit still has an ack time.  QUEUE is the
+    // wait on the fifo, so SOLVE is the solve alone.  TOTAL runs from
+    // the first byte to the reply.
+    //
+    enum interval_t : uint8_t {
+        LINE,
+        PARSE,
+        QUEUE,
+        SOLVE,
+        I2C,
+        ACK,
+        TOTAL,
+        INTERVAL_COUNT
+    };
+
+    static_assert(STAGE_COUNT == (TOTAL + 1), "Every stage after the first has to end an interval");
+
+    // Reply fields for each interval.
+    //
+    using interval_fields_t = struct {
+        char const* count;
+        char const* p50;
+        char const* p90;
+        char const* p99;
+        char const* max;
+    };
+
+    constexpr interval_fields_t INTERVAL_FIELDS[INTERVAL_COUNT] = {
+        { "line_count",  "line_p50_us",  "line_p90_us",  "line_p99_us",  "line_max_us"  },
+        { "parse_count", "parse_p50_us", "parse_p90_us", "parse_p99_us", "parse_max_us" },
+        { "queue_count", "queue_p50_us", "queue_p90_us", "queue_p99_us", "queue_max_us" },
+        { "solve_count", "solve_p50_us", "solve_p90_us", "solve_p99_us", "solve_max_us" },
+        { "i2c_count",   "i2c_p50_us",   "i2c_p90_us",   "i2c_p99_us",   "i2c_max_us"   },
+        { "ack_count",   "ack_p50_us",   "ack_p90_us",   "ack_p99_us",   "ack_max_us"   },
+        { "total_count", "total_p50_us", "total_p90_us", "total_p99_us", "total_max_us" },
+    };
+
+    /**
+     * @brief  Timestamps of one command, in microseconds.
+     *
+     * @note   Only the low 32 bits of the device time are kept.  The
+     *         intervals are far shorter than the 71 minutes it takes
+     *         them to wrap.
+     */
+    class Stamps
+    {
+    public:
+
+        /**
+         * @brief  Stamp a stage with the current time.
+         * @param  stage  Stage reached.
+         */
+        auto mark(stage_t stage) -> void
+        {
+#if CY22150_LATENCY_STATS
+            mark(stage, time_us_64());
+#else
+            (void)stage;
+#endif
+        }
+
+        /**
+         * @brief  Stamp a stage with a time already taken.
+         * @param  stage    Stage reached.
+         * @param  time_us  Device time, in microseconds.
+         */
+        auto mark(stage_t stage, uint64_t time_us) -> void
+        {
+#if CY22150_LATENCY_STATS
+            us_[stage] = static_cast<uint32_t>(time_us);
+            marked_ |= (1u << stage);
+#else
+            (void)stage;
+            (void)time_us;
+#endif
+        }
+
+        /**
+         * @brief  Take the stamps another set has, replacing any of
+         *         the same stages.
+         * @param  other  Stamps to take.
+         */
+        auto merge(Stamps const& other) -> void
+        {
+#if CY22150_LATENCY_STATS
+            for (size_t stage = 0; stage < STAGE_COUNT; stage++)
+            {
+                if (other.marked_ & (1u << stage))
+                    us_[stage] = other.us_[stage];
+            }
+            marked_ |= other.marked_;
+#else
+            (void)other;
+#endif
+        }
+
+        /**
+         * @brief  Forget every stamp.
+         */
+        auto clear() -> void
+        {
+#if CY22150_LATENCY_STATS
+            marked_ = 0;
+#endif
+        }
+
+        /**
+         * @brief  Return true if a stage has been stamped.
+         * @param  stage  Stage to check.
+         */
+        auto has(stage_t stage) const -> bool
+        {
+#if CY22150_LATENCY_STATS
+            return (marked_ & (1u << stage)) != 0;
+#else
+            (void)stage;
+            return false;
+#endif
+        }
+
+        /**
+         * @brief  Return the time a stage was stamped.
+         * @param  stage  Stage to look up.  It has to have been stamped.
+         */
+        auto at(stage_t stage) const -> uint32_t
+        {
+#if CY22150_LATENCY_STATS
+            return us_[stage];
+#else
+            (void)stage;
+            return 0;
+#endif
+        }
+
+    private:
+
+#if CY22150_LATENCY_STATS
+        std::array<uint32_t, STAGE_COUNT> us_ {};
+        uint8_t marked_ = 0;
+#endif
+    };
+
+    /**
+     * @brief  When bytes reached the receive ring, for stamping the
+     *         first byte of each line.
+     *
+     * @note   The receive interrupt notes the ring position and time
+     *         of each batch of bytes it takes from stdio.  A byte
+     *         arrived with the last batch that started at or before
+     *         it.  Only the last few batches are kept; a byte older
+     *         than all of them gets the oldest time, which is late.
+     */
+    class ArrivalLog
+    {
+    public:
+
+        /**
+         * @brief  Note a batch of bytes.  Interrupt side.
+         * @param  start  Ring position of the first byte.
+         * @param  end    Ring position just past the last byte.
+         */
+        auto note(uint32_t start, uint32_t end) -> void
+        {
+#if CY22150_LATENCY_STATS
+            if (start == end)
+                return;
+
+            entries_[count_ & MASK] = { start, static_cast<uint32_t>(time_us_64()) };
+            count_ = count_ + 1;
+#else
+            (void)start;
+            (void)end;
+#endif
+        }
+
+        /**
+         * @brief  Return when the byte at a ring position arrived.
+         *         Main loop side.
+         * @param  position  Ring position of the byte.
+         */
+        auto time_of(uint32_t position) -> uint32_t
+        {
+#if CY22150_LATENCY_STATS
+            uint32_t interrupts = save_and_disable_interrupts();
+
+            uint32_t count = count_;
+            uint32_t oldest = (count > LOG_LEN) ? (count - LOG_LEN) : 0;
+            uint32_t time_us = (count > 0) ? entries_[oldest & MASK].us
+                                           : static_cast<uint32_t>(time_us_64());
+            for (uint32_t i = count; i > oldest; i--)
+            {
+                entry_t const& entry = entries_[(i - 1) & MASK];
+                if (static_cast<int32_t>(position - entry.position) >= 0)
+                {
+                    time_us = entry.us;
+                    break;
+                }
+            }
+
+            restore_interrupts(interrupts);
+            return time_us;
+#else
+            (void)position;
+            return 0;
+#endif
+        }
+
+    private:
+
+#if CY22150_LATENCY_STATS
+        static const uint32_t LOG_LEN = 8;
+        static const uint32_t MASK = LOG_LEN - 1;
+
+        using entry_t = struct {
+            uint32_t position;
+            uint32_t us;
+        };
+
+        std::array<entry_t, LOG_LEN> entries_ {};
+        volatile uint32_t count_ = 0;
+#endif
+    };
+
+    /**
+     * @brief  Histogram of intervals with fixed buckets.
+     *
+     * @note   Buckets are a quarter of an octave wide, so a percentile
+     *         is at most about 19% high.  Below 4 us every value has
+     *         its own bucket, and anything from about 16 s up goes in
+     *         the last one.
+     */
+    class Histogram
+    {
+    public:
+
+        static const size_t BUCKET_COUNT = 92;
+
+        /**
+         * @brief  Count an interval.
+         * @param  us  Interval, in microseconds.
+         */
+        auto record(uint32_t us) -> void
+        {
+            buckets_[bucket(us)]++;
+            count_++;
+            if (us > max_)
+                max_ = us;
+        }
+
+        /**
+         * @brief  Return the number of intervals counted.
+         */
+        auto count() const -> uint32_t
+        {
+            return count_;
+        }
+
+        /**
+         * @brief  Return the longest interval counted.
+         */
+        auto max() const -> uint32_t
+        {
+            return max_;
+        }
+
+        /**
+         * @brief  Return a percentile.
+         * @param  per_mille  Percentile wanted, in tenths of a
+         *                    percent.
+         * @return Top of the bucket the percentile falls in, but no
+         *         more than the longest interval counted.  0 if
+         *         nothing has been counted.
+         */
+        auto percentile(uint32_t per_mille) const -> uint32_t
+        {
+            if (count_ == 0)
+                return 0;
+
+            uint64_t rank = (static_cast<uint64_t>(count_) * per_mille + 999) / 1000;
+            if (rank == 0)
+                rank = 1;
+
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKET_COUNT; i++)
+            {
+                seen += buckets_[i];
+                if (seen >= rank)
+                    return (top(i) < max_) ? top(i) : max_;
+            }
+            return max_;
+        }
+
+        /**
+         * @brief  Forget everything counted.
+         */
+        auto reset() -> void
+        {
+            buckets_.fill(0);
+            count_ = 0;
+            max_ = 0;
+        }
+
+    private:
+
+        /**
+         * @brief  Return the bucket an interval goes in.
+         * @param  us  Interval, in microseconds.
+         *
+         * @note   Above 3 the bucket is four per octave, from the top
+         *         bit, plus the next two bits down.
+         */
+        static auto bucket(uint32_t us) -> size_t
+        {
+            if (us < 4)
+                return us;
+
+            uint32_t msb = 31 - __builtin_clz(us);
+            size_t index = 4 * (msb - 1) + ((us >> (msb - 2)) & 3);
+            return (index < BUCKET_COUNT) ? index : (BUCKET_COUNT - 1);
+        }
+
+        /**
+         * @brief  Return the largest interval that goes in a bucket.
+         * @param  index  Bucket.
+         */
+        static auto top(size_t index) -> uint32_t
+        {
+            if (index < 4)
+                return static_cast<uint32_t>(index);
+            if (index == (BUCKET_COUNT - 1))
+                return UINT32_MAX;
+
+            uint32_t shift = static_cast<uint32_t>(index / 4) - 1;
+            uint32_t low = static_cast<uint32_t>(4 + (index % 4)) << shift;
+            return low + (1u << shift) - 1;
+        }
+
+        std::array<uint32_t, BUCKET_COUNT> buckets_ {};
+        uint32_t count_ = 0;
+        uint32_t max_ = 0;
+    };
+
+    /**
+     * @brief  Latency histograms for every interval.
+     *
+     * @note   Commands are recorded once they've been answered.  The
+     *         histograms are reported and reset by get_latency.
+     */
+    class Stats
+    {
+    public:
+
+        /**
+         * @brief  Add the intervals of an answered command.
+         * @param  stamps  Timestamps of the command.
+         */
+        auto record(Stamps const& stamps) -> void
+        {
+#if CY22150_LATENCY_STATS
+            int last = stamps.has(RX_FIRST_BYTE) ? RX_FIRST_BYTE : -1;
+            for (int stage = LINE_COMPLETE; stage < STAGE_COUNT; stage++)
+            {
+                if (!stamps.has(static_cast<stage_t>(stage)))
+                    continue;
+
+                if (last >= 0)
+                {
+                    histograms_[stage - 1].record(
+                        stamps.at(static_cast<stage_t>(stage)) - stamps.at(static_cast<stage_t>(last)));
+                }
+                last = stage;
+            }
+
+            if (stamps.has(RX_FIRST_BYTE) && stamps.has(ACK_QUEUED))
+                histograms_[TOTAL].record(stamps.at(ACK_QUEUED) - stamps.at(RX_FIRST_BYTE));
+#else
+            (void)stamps;
+#endif
+        }
+
+#if CY22150_LATENCY_STATS
+        /**
+         * @brief  Return the histogram of an interval.
+         * @param  interval  Interval wanted.
+         */
+        auto histogram(interval_t interval) const -> Histogram const&
+        {
+            return histograms_[interval];
+        }
+#endif
+
+        /**
+         * @brief  Forget everything recorded.
+         */
+        auto reset() -> void
+        {
+#if CY22150_LATENCY_STATS
+            for (Histogram& histogram : histograms_)
+            {
+                histogram.reset();
+            }
+#endif
+        }
+
+    private:
+
+#if CY22150_LATENCY_STATS
+        std::array<Histogram, INTERVAL_COUNT> histograms_ {};
+#endif
+    };
+}
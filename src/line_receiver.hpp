@@ -0,0 +1,381 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "latency_stats.hpp"
+#include "tx_ring.hpp"
+
+/**
+ * @brief  Interrupt driven serial receiver that splits the input
+ *         into lines and binary frames.
+ *
+ * @note   The stdio chars-available callback drains everything the
+ *         USB CDC and UART drivers are holding into a ring buffer in
+ *         one go, so the main loop never polls stdio.  Lines are then
+ *         framed in place: the terminator is overwritten with 0x00 and
+ *         the caller gets a pointer straight into the ring.
+ *
+ * @note   So that a line which wraps round the end of the ring is
+ *         still contiguous, the first MAX_LINE_LEN bytes of the ring
+ *         are mirrored just past its end.  The interrupt writes those
+ *         bytes twice.
+ *
+ * @note   A 0x00 starts a binary frame, which runs up to the next
+ *         0x00 and is handed out raw, without echo.  Text never
+ *         contains 0x00 so the two can be told apart per frame.  An
+ *         unfinished text line in front of a binary frame is dropped.
+ */
+class LineReceiver
+{
+public:
+
+    static const size_t RING_LEN = 2048;
+    static const size_t MAX_LINE_LEN = 1023;
+
+    // A received line.  The text is terminated with 0x00 and can be
+    // modified in place.  If the line was too long it's dropped and
+    // only the overflow flag is set.  For a binary frame the text is
+    // the frame between the delimiters.  The stamps say when the first
+    // byte arrived and when the line was framed.
+    //
+    using line_t = struct {
+        char* text;
+        size_t length;
+        bool overflow;
+        bool binary;
+        latency::Stamps stamps;
+    };
+
+    // Called from next_line() with each character of a text line as
+    // it's framed, so the line can be parsed while it's still
+    // arriving.  A 0x00 means the characters so far have been thrown
+    // away.
+    //
+    using text_callback_t = void (*)(void* context, char character);
+
+    /**
+     * @brief  Constructor.  Registers the chars-available callback.
+     * @param  tx  Ring the echo is sent through.
+     * @note   stdio has to be initialised first.
+     */
+    LineReceiver(TxRing& tx)
+        :tx_(tx)
+    {
+        // Anything already waiting didn't raise a callback so pick it
+        // up here.  Interrupts are off so there's still only one
+        // producer.
+        //
+        uint32_t interrupts = save_and_disable_interrupts();
+        stdio_set_chars_available_callback(on_chars_available, this);
+        receive();
+        restore_interrupts(interrupts);
+    }
+
+    /**
+     * @brief  Echo received characters back to the sender.
+     * @param  flag  true to echo.
+     */
+    auto set_echo(bool flag) -> void
+    {
+        echo_ = flag;
+    }
+
+    /**
+     * @brief  Pass the characters of text lines on as they arrive.
+     * @param  callback  Function to call with each character.
+     * @param  context   Passed to the callback.
+     */
+    auto set_text_callback(text_callback_t callback, void* context) -> void
+    {
+        text_callback_ = callback;
+        text_context_ = context;
+    }
+
+    /**
+     * @brief  Return the next complete line.
+     * @return The line, or nullopt if there isn't a complete one yet.
+     *
+     * @note   The text stays valid until the next call, which hands
+     *         the space back to the interrupt.
+     */
+    auto next_line() -> std::optional<line_t>
+    {
+        // The previous line is finished with.
+        //
+        release(line_start_);
+
+        std::optional<line_t> line = std::nullopt;
+        uint32_t head = head_.load(std::memory_order_acquire);
+        while (!line.has_value() && (scan_ != head))
+        {
+            if (latency::ENABLED && (scan_ == line_start_))
+                stamps_.mark(latency::RX_FIRST_BYTE, arrivals_.time_of(scan_));
+
+            char& character = at(scan_);
+            scan_++;
+
+            if (binary_)
+            {
+                line = next_frame_byte(character);
+                continue;
+            }
+
+            if (character == 0x00)
+            {
+                binary_ = true;
+                crlf_ = false;
+                overflow_ = false;
+                forward(0x00);
+                release(scan_);
+                continue;
+            }
+
+            // A LF right after a CR is part of the same terminator.
+            //
+            if ((character == '\n') && crlf_)
+            {
+                crlf_ = false;
+                release(scan_);
+                continue;
+            }
+            crlf_ = (character == '\r');
+
+            if ((character == '\r') || (character == '\n'))
+            {
+                reflect("\r\n");
+
+                size_t length = scan_ - 1 - line_start_;
+                if (overflow_)
+                {
+                    line = line_t { nullptr, 0, true, false, {} };
+                    overflow_ = false;
+                }
+                else
+                {
+                    character = 0x00;
+                    line = line_t { &at(line_start_), length, false, false, {} };
+                }
+                line_start_ = scan_;
+                stamp_line(line.value());
+            }
+            else if (overflow_)
+            {
+                // Throw the rest of an over-long line away as it
+                // arrives so it doesn't fill the ring.
+                //
+                release(scan_);
+            }
+            else if ((scan_ - line_start_) > MAX_LINE_LEN)
+            {
+                overflow_ = true;
+                forward(0x00);
+                release(scan_);
+            }
+            else
+            {
+                // Anything unprintable becomes white space.  It can't
+                // be dropped without moving the rest of the line.
+                //
+                if ((character < 32) || (character > 126))
+                    character = ' ';
+                char text[] = { character, 0x00 };
+                reflect(text);
+                forward(character);
+            }
+        }
+
+        return line;
+    }
+
+    /**
+     * @brief  Return the number of bytes dropped because the ring was
+     *         full.
+     */
+    auto overflows() -> uint32_t
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    static const size_t MASK = RING_LEN - 1;
+    static const size_t MIRROR_LEN = MAX_LINE_LEN + 1;
+
+    static_assert((RING_LEN & MASK) == 0, "LineReceiver ring length must be a power of two");
+    static_assert(RING_LEN > MIRROR_LEN, "LineReceiver ring must hold a full line");
+
+    /**
+     * @brief  Handle the next byte of a binary frame.
+     * @param  byte  The byte, already consumed.
+     * @return The frame if the byte ends it, nullopt otherwise.
+     *
+     * @note   An empty frame is just a run of delimiters so it's
+     *         skipped and the receiver stays in binary mode.
+     */
+    auto next_frame_byte(char& byte) -> std::optional<line_t>
+    {
+        if (byte != 0x00)
+        {
+            if (overflow_)
+            {
+                release(scan_);
+            }
+            else if ((scan_ - line_start_) > MAX_LINE_LEN)
+            {
+                overflow_ = true;
+                release(scan_);
+            }
+            return std::nullopt;
+        }
+
+        size_t length = scan_ - 1 - line_start_;
+        if (!overflow_ && (length == 0))
+        {
+            release(scan_);
+            return std::nullopt;
+        }
+
+        std::optional<line_t> frame = overflow_
+            ? line_t { nullptr, 0, true, true, {} }
+            : line_t { &at(line_start_), length, false, true, {} };
+        binary_ = false;
+        overflow_ = false;
+        line_start_ = scan_;
+        stamp_line(frame.value());
+        return frame;
+    }
+
+    /**
+     * @brief  Chars-available callback.  Runs in interrupt context.
+     * @param  param  The receiver.
+     */
+    static void on_chars_available(void* param)
+    {
+        static_cast<LineReceiver*>(param)->receive();
+    }
+
+    /**
+     * @brief  Move everything stdio is holding into the ring.
+     *         Producer side only.
+     *
+     * @note   Bytes that don't fit are counted and dropped.  They have
+     *         to be read anyway or the USB driver won't raise another
+     *         callback.
+     */
+    auto receive() -> void
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t start = head;
+
+        int character;
+        while ((character = stdio_getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT)
+        {
+            if ((head - tail) >= RING_LEN)
+            {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                continue;
+            }
+
+            size_t index = head & MASK;
+            ring_[index] = static_cast<char>(character);
+            if (index < MIRROR_LEN)
+                ring_[RING_LEN + index] = static_cast<char>(character);
+            head++;
+        }
+
+        arrivals_.note(start, head);
+        head_.store(head, std::memory_order_release);
+    }
+
+    /**
+     * @brief  Return a byte of the current line.
+     * @param  position  Ring position of the byte.
+     *
+     * @note   Positions are taken relative to the start of the line so
+     *         a line that wraps is read from the mirror.
+     */
+    auto at(uint32_t position) -> char&
+    {
+        return ring_[(line_start_ & MASK) + (position - line_start_)];
+    }
+
+    /**
+     * @brief  Hand everything before a position back to the interrupt.
+     * @param  position  First ring position still in use.
+     */
+    auto release(uint32_t position) -> void
+    {
+        line_start_ = position;
+        tail_.store(position, std::memory_order_release);
+    }
+
+    /**
+     * @brief  Give a line that's just been framed its stamps.
+     * @param  line  The line.
+     */
+    auto stamp_line(line_t& line) -> void
+    {
+        line.stamps = stamps_;
+        line.stamps.mark(latency::LINE_COMPLETE);
+    }
+
+    /**
+     * @brief  Echo text if echo is on.
+     * @param  text  Text to be sent.
+     */
+    auto reflect(char const* text) -> void
+    {
+        if (echo_)
+            tx_.send(text);
+    }
+
+    /**
+     * @brief  Pass a character on to the text callback, if there is
+     *         one.
+     * @param  character  Character of the line, or 0x00.
+     */
+    auto forward(char character) -> void
+    {
+        if (text_callback_)
+            text_callback_(text_context_, character);
+    }
+
+    TxRing& tx_;
+
+    char ring_[RING_LEN + MIRROR_LEN] {};
+
+    // head_ is only written by the interrupt and tail_ by the main
+    // loop.  Everything from tail_ up to head_ belongs to the main
+    // loop, including the line being handed out.
+    //
+    std::atomic<uint32_t> head_ { 0 };
+    std::atomic<uint32_t> tail_ { 0 };
+    std::atomic<uint32_t> dropped_ { 0 };
+
+    // Framing state.  Main loop only.
+    //
+    uint32_t line_start_ = 0;
+    uint32_t scan_ = 0;
+    bool crlf_ = false;
+    bool overflow_ = false;
+    bool binary_ = false;
+    bool echo_ = true;
+
+    // When bytes arrived, and the stamps of the line being framed.
+    // Both are empty, and take no space, unless latency stats are
+    // built in.
+    //
+    [[no_unique_address]] latency::ArrivalLog arrivals_;
+    [[no_unique_address]] latency::Stamps stamps_;
+
+    text_callback_t text_callback_ = nullptr;
+    void* text_context_ = nullptr;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/i2c.h"
+
+/**
+ * @brief  Bus the CY22150 driver talks to on the Pico.  Wraps one of
+ *         the I2C controllers.
+ *
+ * @note   A bus is a template parameter of the driver rather than a
+ *         base class, so this compiles down to a direct call to the
+ *         SDK with nothing in between.  Anything with the same write()
+ *         can stand in for it, such as a mock bus in a host build.
+ */
+class PicoI2cBus
+{
+public:
+
+    /**
+     * @brief  Constructor
+     * @param  i2c  I2C interface to be used to communicate with the
+     *              chip.
+     */
+    PicoI2cBus(i2c_inst_t* i2c)
+        :i2c_(i2c)
+    { };
+
+    /**
+     * @brief  Write a block of bytes to a device in one transaction.
+     *
+     * @param  address  7 bit address of the device.
+     * @param  data     Bytes to write.
+     * @param  length   Number of bytes.
+     *
+     * @return true if every byte was acknowledged.
+     */
+    auto write(uint8_t address, uint8_t const* data, size_t length) -> bool
+    {
+        return i2c_write_blocking(i2c_, address, data, length, false) == static_cast<int>(length);
+    }
+
+private:
+
+    i2c_inst_t* i2c_;
+};
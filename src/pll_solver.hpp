@@ -0,0 +1,226 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief  Integer solver for the CY22150 PLL counters.
+ *
+ * @note   The output frequency is reference * P / (Q * D).  Rather than
+ *         trying every Q and D in floating point, the solver walks the
+ *         continued fraction (Stern-Brocot path) of the ratio P / Q
+ *         required by each candidate divider.  The best approximation
+ *         with bounded P and Q is always either the last convergent on
+ *         that path or the semiconvergent beyond it, so each divider
+ *         costs at most a few dozen integer steps.
+ *
+ * @note   All frequencies are in millihertz so the solver can be fed
+ *         fractional Hz without resorting to float.
+ */
+class PllSolver
+{
+public:
+
+    // Solution returned by the solver.
+    //
+    using pll_settings_t = struct {
+        uint16_t p;
+        uint16_t q;
+        uint16_t d;
+    };
+
+    // Limits taken from the datasheet.  The VCO has to stay between
+    // 100 and 400 MHz and the phase detector has to run at 250 kHz or
+    // better.
+    //
+    static constexpr uint64_t VCO_MIN_MILLIHZ = 100000000000ULL;
+    static constexpr uint64_t VCO_MAX_MILLIHZ = 400000000000ULL;
+    static constexpr uint64_t PFD_MIN_MILLIHZ = 250000000ULL;
+
+    static const uint16_t P_MIN = 16;
+    static const uint16_t P_MAX = 1023;
+    static const uint16_t Q_MIN = 2;
+    static const uint16_t Q_MAX = 127;
+    static const uint16_t D_MIN = 4;
+    static const uint16_t D_MAX = 127;
+
+    /**
+     * @brief  Constructor
+     *
+     * @param  reference_millihz  Reference clock frequency, in mHz.
+     */
+    PllSolver(uint64_t reference_millihz)
+        :reference_(reference_millihz)
+        ,q_max_(static_cast<uint16_t>(
+            (reference_millihz / PFD_MIN_MILLIHZ) > Q_MAX ? Q_MAX :
+            (reference_millihz / PFD_MIN_MILLIHZ) < Q_MIN ? Q_MIN :
+            (reference_millihz / PFD_MIN_MILLIHZ)))
+    { };
+
+    /**
+     * @brief  Find the counter values that best match a frequency.
+     *
+     * @param  frequency_millihz  Desired output frequency, in mHz.
+     *
+     * @return P, Q and D counter values.
+     */
+    auto solve(uint64_t frequency_millihz) -> pll_settings_t
+    {
+        frequency_ = (frequency_millihz > 0) ? frequency_millihz : 1;
+        found_ = false;
+        steps_ = 0;
+        best_ = { P_MIN, Q_MIN, D_MAX };
+
+        // The divider range is the one that keeps the VCO in range.
+        // If the frequency can't be reached with the VCO in range
+        // fall back to the nearest divider and give up on the VCO
+        // limits.
+        //
+        uint64_t d_lo = (VCO_MIN_MILLIHZ + frequency_ - 1) / frequency_;
+        uint64_t d_hi = VCO_MAX_MILLIHZ / frequency_;
+        if (d_lo < D_MIN) { d_lo = D_MIN; }
+        if (d_hi > D_MAX) { d_hi = D_MAX; }
+
+        vco_limited_ = (d_lo <= d_hi);
+        if (!vco_limited_)
+        {
+            d_lo = d_hi = (frequency_ * D_MIN > VCO_MAX_MILLIHZ) ? D_MIN : D_MAX;
+        }
+
+        // Higher dividers run the VCO faster, so try those first.  On
+        // a tie the earlier (faster VCO) solution is kept.
+        //
+        for (uint64_t d = d_hi; d >= d_lo; d--)
+        {
+            solve_divider(static_cast<uint16_t>(d));
+            if (found_ && (best_error_ == 0))
+                break;
+        }
+
+        return best_;
+    }
+
+    /**
+     * @brief  Return the work done by the last solve(), as the number
+     *         of continued fraction steps plus candidates checked.
+     *
+     * @note   For benchmarking.  It's one add per step so it's left in
+     *         the firmware build too.
+     */
+    auto steps() const -> uint32_t
+    {
+        return steps_;
+    }
+
+private:
+
+    /**
+     * @brief  Find the best P / Q for a fixed divider.
+     *
+     * @param  d  Divider value.
+     *
+     * @note   P / Q has to approximate frequency * d / reference.
+     */
+    auto solve_divider(uint16_t d) -> void
+    {
+        uint64_t n = frequency_ * d;
+        uint64_t m = reference_;
+
+        // Walk the convergents until the next one would break the
+        // counter limits.
+        //
+        uint64_t p0 = 0, q0 = 1;
+        uint64_t p1 = 1, q1 = 0;
+        while (m != 0)
+        {
+            uint64_t a  = n / m;
+            uint64_t p2 = p0 + a * p1;
+            uint64_t q2 = q0 + a * q1;
+            if ((p2 > P_MAX) || (q2 > q_max_))
+                break;
+
+            steps_++;
+            p0 = p1; q0 = q1;
+            p1 = p2; q1 = q2;
+
+            uint64_t r = n - a * m;
+            n = m;
+            m = r;
+        }
+
+        // The best approximation is either the last convergent or
+        // the largest semiconvergent that still fits.
+        //
+        if ((p1 == 0) || (q1 == 0))
+            return;
+
+        uint64_t k_q = (q_max_ - q0) / q1;
+        uint64_t k_p = (P_MAX - p0) / p1;
+        uint64_t k   = (k_q < k_p) ? k_q : k_p;
+
+        consider(p1, q1, d);
+        consider(p0 + k * p1, q0 + k * q1, d);
+    }
+
+    /**
+     * @brief  Check a candidate and keep it if it's the best so far.
+     *
+     * @param  p  Candidate P value.
+     * @param  q  Candidate Q value.
+     * @param  d  Candidate divider value.
+     */
+    auto consider(uint64_t p, uint64_t q, uint16_t d) -> void
+    {
+        if ((p == 0) || (q == 0))
+            return;
+
+        steps_++;
+
+        // Small fractions can be scaled up into the counter range
+        // without changing their value.
+        //
+        uint64_t scale = 1;
+        while ((q * scale < Q_MIN) || (p * scale < P_MIN))
+            scale++;
+        p *= scale;
+        q *= scale;
+
+        if ((p > P_MAX) || (q > q_max_))
+            return;
+
+        if (vco_limited_)
+        {
+            uint64_t vco_numer = reference_ * p;
+            if ((vco_numer < VCO_MIN_MILLIHZ * q) || (vco_numer > VCO_MAX_MILLIHZ * q))
+                return;
+        }
+
+        // Compare |reference * p / (q * d) - frequency| exactly by
+        // cross multiplying the error fractions.
+        //
+        uint64_t denom = q * d;
+        uint64_t actual = reference_ * p;
+        uint64_t target = frequency_ * denom;
+        uint64_t error = (actual > target) ? (actual - target) : (target - actual);
+
+        if (!found_ || (error * best_denom_ < best_error_ * denom))
+        {
+            found_ = true;
+            best_error_ = error;
+            best_denom_ = denom;
+            best_ = { static_cast<uint16_t>(p), static_cast<uint16_t>(q), d };
+        }
+    }
+
+    uint64_t reference_;
+    uint16_t q_max_;
+
+    // Search state.
+    //
+    uint64_t frequency_ = 0;
+    bool vco_limited_ = true;
+    bool found_ = false;
+    uint32_t steps_ = 0;
+    uint64_t best_error_ = 0;
+    uint64_t best_denom_ = 1;
+    pll_settings_t best_ = { P_MIN, Q_MIN, D_MAX };
+};
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <array>
+#include <optional>
+
+#include "hardware/irq.h"
+#include "pico/time.h"
+
+#include "cy22150.hpp"
+#include "error_code.hpp"
+#include "spsc_ring.hpp"
+
+/**
+ * @brief  Applies pre-solved changes at a given time.
+ *
+ * @note   Changes are solved when they're scheduled and kept in time
+ *         order.  A hardware alarm fires at the time of the earliest
+ *         one and applies it from interrupt context, so the timing
+ *         doesn't depend on what the main loop is doing.  If the
+ *         alarm lands while the main loop is itself writing to the
+ *         chip it retries shortly afterwards.
+ *
+ * @note   Each alarm applies at most one change, which holds off lower
+ *         priority interrupts for the length of one I2C burst.  A full
+ *         retune is around 20 bytes, roughly 2 ms at 100 kHz.  Further
+ *         changes that are due follow RETRY_US later, so the USB and
+ *         UART interrupts feeding the line receiver get in between.
+ *
+ * @note   Times are on the time_us_64() clock.
+ */
+class Scheduler
+{
+public:
+
+    static const size_t MAX_SCHEDULED = 16;
+
+    // How long to wait before retrying when the chip is busy, and
+    // between changes that are due together.
+    //
+    static const int64_t RETRY_US = 20;
+
+    // Report for a change that has been applied.
+    //
+    using scheduled_event_t = struct {
+        int command_number;
+        std::optional<uint32_t> seq;
+        uint64_t apply_at_us;
+        uint64_t applied_us;
+    };
+
+    /**
+     * @brief  Constructor
+     * @param  dds  Clock generator the changes are applied to.
+     */
+    Scheduler(CY22150& dds)
+        :dds_(dds)
+    { };
+
+    /**
+     * @brief  Schedule a change.
+     *
+     * @param  command_number  Command that asked for the change.
+     * @param  seq             Sequence number of that command, if any.
+     * @param  apply_at_us     When to apply the change.
+     * @param  image           Register image to apply.
+     *
+     * @return Error if the queue is full, nullopt otherwise.
+     *
+     * @note   A time in the past is applied straight away, from the
+     *         caller rather than from the alarm, so the I2C burst
+     *         doesn't run with interrupts disabled.
+     */
+    auto schedule(int command_number, std::optional<uint32_t> seq, uint64_t apply_at_us,
+                  CY22150::register_image_t const& image) -> std::optional<error_code_t>
+    {
+        uint32_t interrupts = save_and_disable_interrupts();
+
+        if (count_ >= MAX_SCHEDULED)
+        {
+            restore_interrupts(interrupts);
+            return std::make_optional(error_code_t::SCHEDULE_FULL);
+        }
+
+        // Insert in time order.  Equal times keep the order in which
+        // they were scheduled.
+        //
+        size_t position = count_;
+        while ((position > 0) && (queue_[position - 1].apply_at_us > apply_at_us))
+        {
+            queue_[position] = queue_[position - 1];
+            position--;
+        }
+        queue_[position] = { command_number, seq, apply_at_us, image };
+        count_++;
+
+        // A new earliest entry needs the alarm moving, unless it's
+        // already due.
+        //
+        bool due = (position == 0) && (apply_at_us <= time_us_64());
+        if ((position == 0) && !due)
+        {
+            arm();
+        }
+
+        restore_interrupts(interrupts);
+
+        if (due)
+        {
+            apply_past_due();
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief  Drop everything that hasn't been applied yet.
+     */
+    auto clear() -> void
+    {
+        uint32_t interrupts = save_and_disable_interrupts();
+        if (alarm_ > 0)
+        {
+            cancel_alarm(alarm_);
+            alarm_ = 0;
+        }
+        count_ = 0;
+        restore_interrupts(interrupts);
+    }
+
+    /**
+     * @brief  Return the number of changes waiting to be applied.
+     */
+    auto size() -> size_t
+    {
+        return count_;
+    }
+
+    /**
+     * @brief  Report a change that has been applied.
+     * @return Report if a change has been applied since the last
+     *         call, nullopt otherwise.
+     */
+    auto loop() -> std::optional<scheduled_event_t>
+    {
+        scheduled_event_t event {};
+        if (!events_.pop(event))
+            return std::nullopt;
+
+        return event;
+    }
+
+private:
+
+    // A change waiting to be applied.
+    //
+    using scheduled_t = struct {
+        int command_number;
+        std::optional<uint32_t> seq;
+        uint64_t apply_at_us;
+        CY22150::register_image_t image;
+    };
+
+    /**
+     * @brief  Set the alarm for the earliest entry.
+     * @note   Called with interrupts disabled.
+     *
+     * @note   The alarm is never allowed to fire from inside
+     *         add_alarm_at(), which would apply the entry with
+     *         interrupts still disabled.  An entry whose time has
+     *         passed gets an alarm RETRY_US from now instead.
+     */
+    auto arm() -> void
+    {
+        if (alarm_ > 0)
+        {
+            cancel_alarm(alarm_);
+            alarm_ = 0;
+        }
+
+        if (count_ > 0)
+        {
+            alarm_id_t alarm = add_alarm_at(
+                from_us_since_boot(queue_[0].apply_at_us), on_alarm, this, false);
+            if (alarm == 0)
+            {
+                alarm = add_alarm_at(
+                    from_us_since_boot(time_us_64() + RETRY_US), on_alarm, this, false);
+            }
+
+            if ((alarm > 0) && (alarm_ == 0))
+            {
+                alarm_ = alarm;
+            }
+        }
+    }
+
+    /**
+     * @brief  Apply the entries that are due from the main loop.
+     *
+     * @note   The entry stays at the head of the queue while it's
+     *         applied so the order holds.  The alarm callback treats
+     *         the main loop applying it like a busy chip and retries.
+     */
+    auto apply_past_due() -> void
+    {
+        while (true)
+        {
+            uint32_t interrupts = save_and_disable_interrupts();
+            if ((count_ == 0) || (queue_[0].apply_at_us > time_us_64()))
+            {
+                restore_interrupts(interrupts);
+                return;
+            }
+            applying_ = true;
+            restore_interrupts(interrupts);
+
+            uint64_t applied_us = time_us_64();
+            dds_.apply(queue_[0].image);
+
+            interrupts = save_and_disable_interrupts();
+            applied(applied_us);
+            applying_ = false;
+            restore_interrupts(interrupts);
+        }
+    }
+
+    /**
+     * @brief  Report the entry at the head of the queue as applied
+     *         and remove it.
+     * @param  applied_us  When it was applied.
+     *
+     * @note   Called from the alarm callback, or with interrupts
+     *         disabled.  Reports are dropped rather than overwritten
+     *         if the main loop falls behind.
+     */
+    auto applied(uint64_t applied_us) -> void
+    {
+        events_.push({ queue_[0].command_number, queue_[0].seq, queue_[0].apply_at_us, applied_us });
+
+        for (size_t i = 1; i < count_; i++)
+            queue_[i - 1] = queue_[i];
+        count_--;
+    }
+
+    /**
+     * @brief  Alarm callback.  Runs in interrupt context.
+     * @param  id         Alarm that fired.
+     * @param  user_data  The scheduler.
+     * @return Zero, or a negative delay to retry after.
+     */
+    static auto on_alarm(alarm_id_t id, void* user_data) -> int64_t
+    {
+        return static_cast<Scheduler*>(user_data)->apply_due(id);
+    }
+
+    /**
+     * @brief  Apply the entry that is due.  Runs in interrupt context.
+     * @param  id  Alarm that fired.
+     * @return Zero, or a negative delay to retry after.
+     *
+     * @note   On a retry the SDK reuses the alarm, so it stays current.
+     *         A retry also picks up the next entry when more than one
+     *         is due.
+     */
+    auto apply_due(alarm_id_t id) -> int64_t
+    {
+        alarm_ = 0;
+        if ((count_ > 0) && (queue_[0].apply_at_us <= time_us_64()))
+        {
+            if (dds_.is_busy() || applying_)
+            {
+                alarm_ = id;
+                return -RETRY_US;
+            }
+
+            uint64_t applied_us = time_us_64();
+            dds_.apply(queue_[0].image);
+            applied(applied_us);
+        }
+
+        if ((count_ > 0) && (queue_[0].apply_at_us <= time_us_64()))
+        {
+            alarm_ = id;
+            return -RETRY_US;
+        }
+
+        arm();
+        return 0;
+    }
+
+    CY22150& dds_;
+
+    // Entries in time order.  Changed by the main loop with interrupts
+    // disabled, and by the alarm callback.
+    //
+    std::array<scheduled_t, MAX_SCHEDULED> queue_ {};
+    volatile size_t count_ = 0;
+    volatile alarm_id_t alarm_ = 0;
+
+    // Set while the main loop applies an entry that was already due.
+    //
+    volatile bool applying_ = false;
+
+    // Reports for applied entries.  Written by the alarm callback, or
+    // by the main loop with interrupts disabled, and read by the main
+    // loop.
+    //
+    SpscRing<scheduled_event_t, MAX_SCHEDULED> events_ {};
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief  Fixed capacity single producer, single consumer ring buffer.
+ *
+ * @note   No heap and no locks.  The producer only writes head_ and
+ *         the consumer only writes tail_, so one side can run on the
+ *         other core or in an interrupt handler.  Only atomic loads
+ *         and stores are used, which the Cortex-M0+ can do without
+ *         library support.
+ *
+ * @note   The capacity has to be a power of two.  Indices run freely
+ *         and are masked on use.
+ */
+template <typename T, size_t N>
+class SpscRing
+{
+    static_assert((N > 0) && ((N & (N - 1)) == 0), "SpscRing capacity must be a power of two");
+
+public:
+
+    /**
+     * @brief  Add an entry.  Producer side only.
+     * @param  value  Entry to be added.
+     * @return false if the ring is full.  The entry is dropped and
+     *         counted as an overflow.
+     */
+    auto push(T const& value) -> bool
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        if ((head - tail) >= N)
+        {
+            overflows_.store(overflows_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        buffer_[head & (N - 1)] = value;
+        head_.store(head + 1, std::memory_order_release);
+
+        uint32_t depth = head + 1 - tail;
+        if (depth > high_water_.load(std::memory_order_relaxed))
+            high_water_.store(depth, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    /**
+     * @brief  Remove the oldest entry.  Consumer side only.
+     * @param  value  Set to the entry removed.
+     * @return false if the ring is empty.
+     */
+    auto pop(T& value) -> bool
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+
+        value = buffer_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief  Return an entry without removing it.  Consumer side
+     *         only.
+     * @param  offset  Number of entries after the oldest.
+     * @return Pointer to the entry, or nullptr if the ring doesn't
+     *         hold that many.
+     */
+    auto peek(size_t offset = 0) -> T*
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        return ((head - tail) <= offset) ? nullptr : &buffer_[(tail + offset) & (N - 1)];
+    }
+
+    /**
+     * @brief  Remove the oldest entries without copying them out.
+     *         Consumer side only.
+     * @param  count  Number of entries to remove.  No more than the
+     *                ring holds.
+     *
+     * @note   Entries read through peek() stay put until they're
+     *         dropped, so the consumer can work on them in place.
+     */
+    auto drop(size_t count) -> void
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        tail_.store(tail + static_cast<uint32_t>(count), std::memory_order_release);
+    }
+
+    /**
+     * @brief  Return the number of entries in the ring.
+     */
+    auto size() const -> size_t
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief  Return true if the ring is empty.
+     */
+    auto empty() const -> bool
+    {
+        return size() == 0;
+    }
+
+    /**
+     * @brief  Return the capacity of the ring.
+     */
+    static constexpr auto capacity() -> size_t
+    {
+        return N;
+    }
+
+    /**
+     * @brief  Return the most entries the ring has held at once.
+     */
+    auto high_water() const -> uint32_t
+    {
+        return high_water_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief  Return the number of entries dropped because the ring
+     *         was full.
+     */
+    auto overflows() const -> uint32_t
+    {
+        return overflows_.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    std::array<T, N> buffer_ {};
+    std::atomic<uint32_t> head_ { 0 };
+    std::atomic<uint32_t> tail_ { 0 };
+
+    // Statistics.  Only written by the producer.
+    //
+    std::atomic<uint32_t> high_water_ { 0 };
+    std::atomic<uint32_t> overflows_ { 0 };
+};
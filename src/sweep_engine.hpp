@@ -0,0 +1,232 @@
+#pragma once
+
+#include <optional>
+
+#include "pico/time.h"
+
+#include "cy22150.hpp"
+#include "error_code.hpp"
+#include "frequency.hpp"
+
+/**
+ * @brief  On-device frequency sweep.
+ *
+ * @note   A repeating hardware timer marks when each step is due.  The
+ *         timer callback runs in interrupt context so it only counts
+ *         ticks; the step itself (solver and I2C) runs from loop() in
+ *         the main loop.
+ */
+class SweepEngine
+{
+public:
+
+    // Sweep settings.  A non-zero step_ppm selects a log sweep, where
+    // each step multiplies the frequency by (1 + step_ppm / 1e6).
+    // A repeat of zero sweeps until stopped.
+    //
+    using sweep_config_t = struct {
+        millihertz_t start;
+        millihertz_t stop;
+        millihertz_t step;
+        uint32_t step_ppm;
+        uint32_t dwell_us;
+        uint32_t repeat;
+    };
+
+    // Progress report for one step.
+    //
+    using sweep_progress_t = struct {
+        uint32_t pass;
+        uint32_t index;
+        millihertz_t frequency;
+        uint32_t overruns;
+        bool done;
+    };
+
+    // Shortest dwell accepted.  Each step costs a solve and a handful
+    // of I2C transactions at 100 kHz.
+    //
+    static const uint32_t MIN_DWELL_US = 2000;
+    static const uint32_t PPM = 1000000;
+
+    /**
+     * @brief  Constructor
+     * @param  dds  Clock generator being swept.
+     */
+    SweepEngine(CY22150& dds)
+        :dds_(dds)
+    { };
+
+    /**
+     * @brief  Start a sweep.
+     * @param  config  Sweep settings.
+     * @return Error if the settings are invalid, nullopt otherwise.
+     *
+     * @note   The first point is committed before returning.  Any
+     *         sweep already running is stopped.
+     */
+    auto start(sweep_config_t const& config) -> std::optional<error_code_t>
+    {
+        stop();
+
+        if ((config.start == 0) || (config.stop == 0))
+            return std::make_optional(error_code_t::SWEEP_LIMITS_REQUIRED);
+        if ((config.step == 0) && (config.step_ppm == 0))
+            return std::make_optional(error_code_t::SWEEP_STEP_REQUIRED);
+        if (config.step_ppm > PPM)
+            return std::make_optional(error_code_t::SWEEP_STEP_PPM);
+        if (config.dwell_us < MIN_DWELL_US)
+            return std::make_optional(error_code_t::SWEEP_DWELL);
+
+        config_ = config;
+        ascending_ = (config_.stop >= config_.start);
+        pass_ = 0;
+        index_ = 0;
+        overruns_ = 0;
+        steps_ = 0;
+        ticks_ = 0;
+
+        point_ = config_.start;
+        dds_.set_frequency(point_);
+        dds_.commit();
+
+        running_ = add_repeating_timer_us(
+            -static_cast<int64_t>(config_.dwell_us), on_timer, this, &timer_);
+        if (!running_)
+            return std::make_optional(error_code_t::SWEEP_TIMER);
+
+        return std::nullopt;
+    }
+
+    /**
+     * @brief  Stop the sweep, leaving the output at the current point.
+     */
+    auto stop() -> void
+    {
+        if (running_)
+        {
+            cancel_repeating_timer(&timer_);
+            running_ = false;
+        }
+    }
+
+    /**
+     * @brief  Return true while a sweep is running.
+     */
+    auto is_running() -> bool
+    {
+        return running_;
+    }
+
+    /**
+     * @brief  Take the next step if one is due.
+     * @return Progress if a step was taken, nullopt otherwise.
+     *
+     * @note   Steps that came due while the main loop was busy are
+     *         not skipped.  The sweep resynchronises to the timer and
+     *         the miss is counted as an overrun.
+     */
+    auto loop() -> std::optional<sweep_progress_t>
+    {
+        if (!running_)
+            return std::nullopt;
+
+        uint32_t ticks = ticks_;
+        if (ticks == steps_)
+            return std::nullopt;
+
+        if ((ticks - steps_) > 1)
+            overruns_ += (ticks - steps_) - 1;
+        steps_ = ticks;
+
+        bool done = false;
+        std::optional<millihertz_t> frequency = next_frequency(point_);
+        if (frequency.has_value())
+        {
+            index_++;
+        }
+        else
+        {
+            pass_++;
+            done = (config_.repeat != 0) && (pass_ >= config_.repeat);
+            frequency = config_.start;
+            index_ = 0;
+        }
+
+        if (done)
+        {
+            stop();
+            return sweep_progress_t { pass_, index_, dds_.get_frequency(), overruns_, true };
+        }
+
+        point_ = frequency.value();
+        dds_.set_frequency(point_);
+        dds_.commit();
+
+        return sweep_progress_t { pass_, index_, dds_.get_frequency(), overruns_, false };
+    }
+
+private:
+
+    /**
+     * @brief  Work out the next point in the sweep.
+     * @param  frequency  Current point, in mHz.
+     * @return Next point, or nullopt if the pass is complete.
+     *
+     * @note   Log steps are computed in two halves so the product
+     *         can't overflow 64 bits.
+     */
+    auto next_frequency(millihertz_t frequency) -> std::optional<millihertz_t>
+    {
+        millihertz_t delta = config_.step;
+        if (config_.step_ppm != 0)
+        {
+            delta = (frequency / PPM) * config_.step_ppm +
+                    ((frequency % PPM) * config_.step_ppm) / PPM;
+            if (delta == 0) { delta = 1; }
+        }
+
+        if (ascending_)
+        {
+            millihertz_t next = frequency + delta;
+            return (next <= config_.stop) ? std::make_optional(next) : std::nullopt;
+        }
+        else
+        {
+            if (delta > frequency)
+                return std::nullopt;
+            millihertz_t next = frequency - delta;
+            return (next >= config_.stop) ? std::make_optional(next) : std::nullopt;
+        }
+    }
+
+    /**
+     * @brief  Timer callback.  Runs in interrupt context.
+     * @param  timer  Timer that fired.
+     * @return true to keep the timer running.
+     */
+    static auto on_timer(repeating_timer_t* timer) -> bool
+    {
+        SweepEngine* engine = static_cast<SweepEngine*>(timer->user_data);
+        engine->ticks_ = engine->ticks_ + 1;
+        return true;
+    }
+
+    CY22150& dds_;
+
+    sweep_config_t config_ {};
+    bool ascending_ = true;
+    bool running_ = false;
+    repeating_timer_t timer_ {};
+
+    // Sweep position.  point_ is the requested frequency, before the
+    // solver rounds it.  ticks_ is only written by the timer callback
+    // and steps_ only by the main loop.
+    //
+    millihertz_t point_ = 0;
+    uint32_t pass_ = 0;
+    uint32_t index_ = 0;
+    uint32_t overruns_ = 0;
+    uint32_t steps_ = 0;
+    volatile uint32_t ticks_ = 0;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <optional>
+
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "pico/time.h"
+
+#include "cy22150.hpp"
+#include "error_code.hpp"
+#include "hop_table.hpp"
+
+/**
+ * @brief  Steps through the hop table on an external GPIO edge.
+ *
+ * @note   The GPIO interrupt runs at the highest priority and applies
+ *         the next pre-solved register image straight from interrupt
+ *         context.  If the edge lands while the main loop is itself
+ *         writing to the chip the hop is deferred, and loop() applies
+ *         it as soon as the main loop comes back round, so the worst
+ *         case trigger-to-I2C latency is one commit plus one pass of
+ *         the main loop.  Latency is measured from the edge interrupt
+ *         to the start of the register writes and the worst case seen
+ *         is reported.
+ */
+class TriggerEngine
+{
+public:
+
+    // Report for the most recent trigger.
+    //
+    using trigger_event_t = struct {
+        uint32_t count;
+        uint32_t index;
+        uint32_t latency_us;
+        uint32_t max_latency_us;
+        uint32_t missed;
+    };
+
+    /**
+     * @brief  Constructor
+     * @param  dds            Clock generator being hopped.
+     * @param  hops           Table of pre-solved frequencies.
+     * @param  reserved_pins  Mask of GPIOs that can't be used as a
+     *                        trigger because they're already in use.
+     */
+    TriggerEngine(CY22150& dds, HopTable& hops, uint32_t reserved_pins)
+        :dds_(dds)
+        ,hops_(hops)
+        ,reserved_pins_(reserved_pins)
+    { };
+
+    /**
+     * @brief  Start hopping on a GPIO edge.
+     * @param  gpio    GPIO number of the trigger input.
+     * @param  rising  Trigger on the rising edge if true, falling
+     *                 edge otherwise.
+     * @return Error if the trigger can't be armed.
+     *
+     * @note   The first edge moves to the entry after the current one.
+     */
+    auto arm(uint32_t gpio, bool rising) -> std::optional<error_code_t>
+    {
+        if ((gpio >= NUM_BANK0_GPIOS) || ((reserved_pins_ & (1u << gpio)) != 0))
+            return std::make_optional(error_code_t::TRIGGER_GPIO);
+        if (hops_.size() == 0)
+            return std::make_optional(error_code_t::HOP_TABLE_EMPTY);
+
+        disarm();
+
+        instance_ = this;
+        gpio_ = gpio;
+        events_ = rising ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+        index_ = hops_.get_index();
+        count_ = 0;
+        reported_ = 0;
+        missed_ = 0;
+        latency_us_ = 0;
+        max_latency_us_ = 0;
+        pending_ = false;
+
+        gpio_init(gpio_);
+        gpio_set_dir(gpio_, GPIO_IN);
+        irq_set_priority(IO_IRQ_BANK0, PICO_HIGHEST_IRQ_PRIORITY);
+        gpio_set_irq_enabled_with_callback(gpio_, events_, true, on_gpio);
+        armed_ = true;
+
+        return std::nullopt;
+    }
+
+    /**
+     * @brief  Stop hopping on the GPIO edge.
+     */
+    auto disarm() -> void
+    {
+        if (armed_)
+        {
+            gpio_set_irq_enabled(gpio_, events_, false);
+            armed_ = false;
+            pending_ = false;
+        }
+    }
+
+    /**
+     * @brief  Return true while the trigger is armed.
+     */
+    auto is_armed() -> bool
+    {
+        return armed_;
+    }
+
+    /**
+     * @brief  Apply a deferred hop and report new triggers.
+     * @return Report if there have been triggers since the last
+     *         report, nullopt otherwise.
+     */
+    auto loop() -> std::optional<trigger_event_t>
+    {
+        if (!armed_)
+            return std::nullopt;
+
+        // The GPIO interrupt is masked while the deferred hop is
+        // applied so the two can't overlap.
+        //
+        irq_set_enabled(IO_IRQ_BANK0, false);
+        if (pending_)
+        {
+            pending_ = false;
+            advance();
+        }
+        trigger_event_t event { count_, index_, latency_us_, max_latency_us_, missed_ };
+        irq_set_enabled(IO_IRQ_BANK0, true);
+
+        if (event.count == reported_)
+            return std::nullopt;
+
+        reported_ = event.count;
+        return event;
+    }
+
+private:
+
+    /**
+     * @brief  GPIO interrupt callback.
+     * @param  gpio    GPIO that raised the interrupt.
+     * @param  events  Events that occurred.
+     */
+    static void on_gpio(uint gpio, uint32_t events)
+    {
+        if (instance_ && (gpio == instance_->gpio_) && ((events & instance_->events_) != 0))
+        {
+            instance_->on_edge();
+        }
+    }
+
+    /**
+     * @brief  Handle a trigger edge.  Runs in interrupt context.
+     */
+    auto on_edge() -> void
+    {
+        uint64_t now_us = time_us_64();
+        if (pending_)
+        {
+            missed_ = missed_ + 1;
+            return;
+        }
+
+        edge_us_ = now_us;
+        if (dds_.is_busy())
+        {
+            pending_ = true;
+            return;
+        }
+        advance();
+    }
+
+    /**
+     * @brief  Apply the next table entry and record the latency.
+     */
+    auto advance() -> void
+    {
+        uint32_t index = (index_ + 1 < hops_.size()) ? (index_ + 1) : 0;
+
+        uint32_t latency_us = static_cast<uint32_t>(time_us_64() - edge_us_);
+        hops_.hop(index);
+
+        index_ = index;
+        latency_us_ = latency_us;
+        if (latency_us > max_latency_us_)
+            max_latency_us_ = latency_us;
+        count_ = count_ + 1;
+    }
+
+    // The SDK has a single GPIO callback so it needs to find the
+    // armed instance.
+    //
+    static inline TriggerEngine* instance_ = nullptr;
+
+    CY22150& dds_;
+    HopTable& hops_;
+    uint32_t reserved_pins_;
+
+    uint gpio_ = 0;
+    uint32_t events_ = 0;
+    bool armed_ = false;
+
+    // Trigger state.  Written from interrupt context.
+    //
+    volatile bool pending_ = false;
+    volatile uint64_t edge_us_ = 0;
+    volatile uint32_t index_ = 0;
+    volatile uint32_t count_ = 0;
+    volatile uint32_t missed_ = 0;
+    volatile uint32_t latency_us_ = 0;
+    volatile uint32_t max_latency_us_ = 0;
+    uint32_t reported_ = 0;
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+#if LIB_PICO_STDIO_UART
+#include "hardware/uart.h"
+#include "pico/stdio_uart.h"
+#endif
+
+#if LIB_PICO_STDIO_USB
+#include "pico/stdio_usb.h"
+#include "tusb.h"
+#endif
+
+/**
+ * @brief  Transmit ring buffer.  Everything sent to the host goes
+ *         through here so that nothing in the main loop waits on
+ *         stdio.
+ *
+ * @note   Output is built in the ring as whole messages.  A message
+ *         only becomes visible to the drain once it's committed, and
+ *         one that doesn't fit is dropped whole and counted, so the
+ *         host never sees half a reply.
+ *
+ * @note   loop() drains the ring straight into the stdio drivers,
+ *         skipping the CR/LF translation and the per-character calls
+ *         of putchar_raw().  Each pass hands over as much as the UART
+ *         FIFO and the USB CDC buffer will take without waiting, up to
+ *         the end of the ring, in one write and one flush per driver.
+ *         The UART hardware and the USB task then send it in the
+ *         background.  Both ends run in the main loop.
+ */
+class TxRing
+{
+public:
+
+    static const size_t RING_LEN = 8192;
+
+    /**
+     * @brief  Start a new message, throwing away any message that was
+     *         started and never committed.
+     */
+    auto begin() -> void
+    {
+        staged_ = head_;
+        overflow_ = false;
+    }
+
+    /**
+     * @brief  Add a byte to the message.
+     * @param  byte  Byte to add.
+     */
+    auto put(char byte) -> void
+    {
+        if ((staged_ - tail_) >= RING_LEN)
+        {
+            overflow_ = true;
+            return;
+        }
+        ring_[staged_ & MASK] = byte;
+        staged_++;
+    }
+
+    /**
+     * @brief  Add text to the message.
+     * @param  text  Null terminated text.
+     */
+    auto put(char const* text) -> void
+    {
+        while (*text)
+            put(*text++);
+    }
+
+    /**
+     * @brief  Add raw bytes to the message.
+     * @param  data    Bytes to add.
+     * @param  length  Number of bytes.
+     */
+    auto put(void const* data, size_t length) -> void
+    {
+        uint8_t const* bytes = static_cast<uint8_t const*>(data);
+        for (size_t i = 0; i < length; i++)
+            put(static_cast<char>(bytes[i]));
+    }
+
+    /**
+     * @brief  Hand the message to the drain.
+     * @return false if the message didn't fit and was dropped.
+     */
+    auto commit() -> bool
+    {
+        if (overflow_)
+        {
+            dropped_++;
+            return false;
+        }
+        head_ = staged_;
+        return true;
+    }
+
+    /**
+     * @brief  Send text as a message of its own.
+     * @param  text  Null terminated text.
+     */
+    auto send(char const* text) -> void
+    {
+        begin();
+        put(text);
+        commit();
+    }
+
+    /**
+     * @brief  Return the number of bytes that can still be queued.
+     */
+    auto space() -> size_t
+    {
+        return RING_LEN - (head_ - tail_);
+    }
+
+    /**
+     * @brief  Return the number of messages dropped because the ring
+     *         was full.
+     */
+    auto dropped() -> uint32_t
+    {
+        return dropped_;
+    }
+
+    /**
+     * @brief  Pass queued bytes on to stdio without waiting.
+     */
+    auto loop() -> void
+    {
+        size_t length = std::min<size_t>(head_ - tail_, RING_LEN - (tail_ & MASK));
+        length = std::min(length, writable());
+        if (length == 0)
+            return;
+
+        char const* data = &ring_[tail_ & MASK];
+#if LIB_PICO_STDIO_UART
+        stdio_uart.out_chars(data, static_cast<int>(length));
+#endif
+#if LIB_PICO_STDIO_USB
+        stdio_usb.out_chars(data, static_cast<int>(length));
+#endif
+        (void)data;
+        tail_ += length;
+    }
+
+private:
+
+    static const size_t MASK = RING_LEN - 1;
+    static_assert((RING_LEN & MASK) == 0, "TxRing length must be a power of two");
+
+    // Depth of the UART transmit FIFO.
+    //
+    static const size_t UART_FIFO_LEN = 32;
+
+    /**
+     * @brief  Return the number of bytes every stdio output can take
+     *         straight away.
+     *
+     * @note   The UART only says whether its FIFO is full or empty, so
+     *         anything in between counts as room for one byte.  A USB
+     *         port with nothing connected drops output rather than
+     *         waiting so it doesn't hold anything up.
+     */
+    auto writable() -> size_t
+    {
+        size_t room = RING_LEN;
+#if LIB_PICO_STDIO_UART
+        if (uart_get_hw(uart_default)->fr & UART_UARTFR_TXFE_BITS)
+            room = UART_FIFO_LEN;
+        else if (uart_is_writable(uart_default))
+            room = 1;
+        else
+            return 0;
+#endif
+#if LIB_PICO_STDIO_USB
+        if (stdio_usb_connected())
+            room = std::min<size_t>(room, tud_cdc_write_available());
+#endif
+        return room;
+    }
+
+    char ring_[RING_LEN] {};
+
+    // Bytes from tail_ up to head_ are waiting to be sent.  staged_
+    // runs ahead of head_ while a message is being built.
+    //
+    uint32_t head_ = 0;
+    uint32_t tail_ = 0;
+    uint32_t staged_ = 0;
+    uint32_t dropped_ = 0;
+    bool overflow_ = false;
+};
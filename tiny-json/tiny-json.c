@@ -459,3 +459,236 @@ static char* setToNull( char* ch ) {
 static bool isEndOfPrimitive( char ch ) {
     return ch == ',' || isOneOfThem( ch, blank ) || isOneOfThem( ch, endofblock );
 }
+
+/** States of the stream parser. */
+enum {
+    STREAM_ROOT,        /**< Waiting for the root object or array.   */
+    STREAM_KEY_FIRST,   /**< Waiting for the first name or '}'.      */
+    STREAM_KEY,         /**< Waiting for a name.                     */
+    STREAM_NAME,        /**< Inside a name.                          */
+    STREAM_NAME_ESCAPE, /**< After a '\\' inside a name.             */
+    STREAM_COLON,       /**< Waiting for the ':' after a name.       */
+    STREAM_VALUE_FIRST, /**< Waiting for the first value or ']'.     */
+    STREAM_VALUE,       /**< Waiting for a value.                    */
+    STREAM_TEXT,        /**< Inside a text value.                    */
+    STREAM_TEXT_ESCAPE, /**< After a '\\' inside a text value.       */
+    STREAM_PRIMITIVE,   /**< Inside a number, true, false or null.   */
+    STREAM_NEXT,        /**< Waiting for ',' or the end of a block.  */
+    STREAM_DONE,        /**< The root object or array is closed.     */
+    STREAM_ERROR        /**< Something was wrong.                    */
+};
+
+/* Initialize a stream parser. */
+void json_streamInit( jsonStream_t* stream, jsonCallback_t callback, void* context ) {
+    stream->callback = callback;
+    stream->context = context;
+    stream->state = STREAM_ROOT;
+    stream->depth = 0;
+    stream->arrays = 0;
+    stream->nameLen = 0;
+    stream->valueStart = 0;
+    stream->length = 0;
+}
+
+/* Get the state of a stream parser. */
+jsonStreamStatus_t json_streamStatus( jsonStream_t const* stream ) {
+    if ( stream->state == STREAM_DONE ) return JSON_STREAM_DONE;
+    if ( stream->state == STREAM_ERROR ) return JSON_STREAM_ERROR;
+    return JSON_STREAM_MORE;
+}
+
+/** Put the stream parser in the error state.
+  * @param stream The stream parser.
+  * @return JSON_STREAM_ERROR */
+static jsonStreamStatus_t streamError( jsonStream_t* stream ) {
+    stream->state = STREAM_ERROR;
+    return JSON_STREAM_ERROR;
+}
+
+/** Append a character to the token of a stream parser.
+  * Room is always left for the two characters that close a token.
+  * @param stream The stream parser.
+  * @param ch The character.
+  * @return true or false if there was room or not. */
+static bool streamStore( jsonStream_t* stream, char ch ) {
+    if ( stream->length + 2 >= sizeof stream->token ) return false;
+    stream->token[ stream->length++ ] = ch;
+    return true;
+}
+
+/** Close a string in the token of a stream parser and replace its escape
+  * characters by their meaning characters.
+  * @param stream The stream parser.
+  * @param start Index of the first character of the string.
+  * @return true or false if the string is valid or not. */
+static bool streamString( jsonStream_t* stream, unsigned int start ) {
+    stream->token[ stream->length++ ] = '\"';
+    stream->token[ stream->length ] = '\0';
+    return 0 != parseString( stream->token + start );
+}
+
+/** Get the name of the property the token of a stream parser belongs to.
+  * @param stream The stream parser.
+  * @return The name or null pointer if it is unnamed. */
+static char const* streamName( jsonStream_t const* stream ) {
+    return stream->nameLen ? stream->token : 0;
+}
+
+/** Check the primitive value in the token of a stream parser and raise its event.
+  * The checks of json_create are reused by closing the token with a ','.
+  * @param stream The stream parser.
+  * @return true or false if the value is valid or not. */
+static bool streamPrimitive( jsonStream_t* stream ) {
+    stream->token[ stream->length++ ] = ',';
+    stream->token[ stream->length ] = '\0';
+    char* ptr = stream->token + stream->valueStart;
+    json_t property;
+    property.u.value = ptr;
+    switch( *ptr ) {
+        case 't':  ptr = trueValue( ptr, &property );  break;
+        case 'f':  ptr = falseValue( ptr, &property ); break;
+        case 'n':  ptr = nullValue( ptr, &property );  break;
+        default:   ptr = numValue( ptr, &property );   break;
+    }
+    if ( !ptr ) return false;
+    stream->callback( stream->context, JSON_VALUE, property.type, streamName( stream ),
+                      property.u.value, stream->depth );
+    return true;
+}
+
+/** Open an object or an array in a stream parser and raise its event.
+  * @param stream The stream parser.
+  * @param ch '{' or '['.
+  * @return The state of the parser. */
+static jsonStreamStatus_t streamOpen( jsonStream_t* stream, char ch ) {
+    if ( stream->depth >= JSON_STREAM_MAX_DEPTH ) return streamError( stream );
+    bool const array = ch == '[';
+    stream->callback( stream->context, JSON_BEGIN, array ? JSON_ARRAY : JSON_OBJ,
+                      streamName( stream ), 0, stream->depth );
+    if ( array ) stream->arrays |= (uint32_t)1 << stream->depth;
+    else stream->arrays &= ~( (uint32_t)1 << stream->depth );
+    ++stream->depth;
+    stream->nameLen = 0;
+    stream->length = 0;
+    stream->state = array ? STREAM_VALUE_FIRST : STREAM_KEY_FIRST;
+    return JSON_STREAM_MORE;
+}
+
+/** Close an object or an array in a stream parser and raise its event.
+  * @param stream The stream parser.
+  * @param ch '}' or ']'.
+  * @return The state of the parser. */
+static jsonStreamStatus_t streamClose( jsonStream_t* stream, char ch ) {
+    bool const array = 0 != ( stream->arrays & ( (uint32_t)1 << ( stream->depth - 1 ) ) );
+    if ( ch != ( array ? ']' : '}' ) ) return streamError( stream );
+    --stream->depth;
+    stream->callback( stream->context, JSON_END, array ? JSON_ARRAY : JSON_OBJ,
+                      0, 0, stream->depth );
+    stream->state = stream->depth ? STREAM_NEXT : STREAM_DONE;
+    return json_streamStatus( stream );
+}
+
+/* Feed the next character to a stream parser. */
+jsonStreamStatus_t json_streamFeed( jsonStream_t* stream, char ch ) {
+    bool const isBlank = isOneOfThem( ch, blank );
+    switch( stream->state ) {
+        case STREAM_ROOT:
+            if ( isBlank ) break;
+            if ( ch != '{' && ch != '[' ) return streamError( stream );
+            return streamOpen( stream, ch );
+
+        case STREAM_KEY_FIRST:
+            if ( ch == '}' ) return streamClose( stream, ch );
+            /* fall through */
+        case STREAM_KEY:
+            if ( isBlank ) break;
+            if ( ch != '\"' ) return streamError( stream );
+            stream->length = 0;
+            stream->state = STREAM_NAME;
+            break;
+
+        case STREAM_NAME:
+            if ( ch == '\"' ) {
+                if ( !streamString( stream, 0 ) ) return streamError( stream );
+                stream->nameLen = (unsigned int)strlen( stream->token ) + 1;
+                stream->length = stream->nameLen;
+                stream->state = STREAM_COLON;
+                break;
+            }
+            if ( ch == '\\' ) stream->state = STREAM_NAME_ESCAPE;
+            if ( !streamStore( stream, ch ) ) return streamError( stream );
+            break;
+
+        case STREAM_NAME_ESCAPE:
+            if ( !streamStore( stream, ch ) ) return streamError( stream );
+            stream->state = STREAM_NAME;
+            break;
+
+        case STREAM_COLON:
+            if ( isBlank ) break;
+            if ( ch != ':' ) return streamError( stream );
+            stream->state = STREAM_VALUE;
+            break;
+
+        case STREAM_VALUE_FIRST:
+            if ( ch == ']' ) return streamClose( stream, ch );
+            /* fall through */
+        case STREAM_VALUE:
+            if ( isBlank ) break;
+            if ( ch == '{' || ch == '[' ) return streamOpen( stream, ch );
+            if ( isEndOfPrimitive( ch ) || ch == ':' ) return streamError( stream );
+            stream->valueStart = stream->length;
+            if ( ch == '\"' ) {
+                stream->state = STREAM_TEXT;
+                break;
+            }
+            stream->state = STREAM_PRIMITIVE;
+            if ( !streamStore( stream, ch ) ) return streamError( stream );
+            break;
+
+        case STREAM_TEXT:
+            if ( ch == '\"' ) {
+                if ( !streamString( stream, stream->valueStart ) ) return streamError( stream );
+                stream->callback( stream->context, JSON_VALUE, JSON_TEXT, streamName( stream ),
+                                  stream->token + stream->valueStart, stream->depth );
+                stream->state = STREAM_NEXT;
+                break;
+            }
+            if ( ch == '\\' ) stream->state = STREAM_TEXT_ESCAPE;
+            if ( !streamStore( stream, ch ) ) return streamError( stream );
+            break;
+
+        case STREAM_TEXT_ESCAPE:
+            if ( !streamStore( stream, ch ) ) return streamError( stream );
+            stream->state = STREAM_TEXT;
+            break;
+
+        case STREAM_PRIMITIVE:
+            if ( !isEndOfPrimitive( ch ) ) {
+                if ( !streamStore( stream, ch ) ) return streamError( stream );
+                break;
+            }
+            if ( !streamPrimitive( stream ) ) return streamError( stream );
+            stream->state = STREAM_NEXT;
+            return json_streamFeed( stream, ch );
+
+        case STREAM_NEXT:
+            if ( isBlank ) break;
+            if ( ch == ',' ) {
+                bool const array = 0 != ( stream->arrays & ( (uint32_t)1 << ( stream->depth - 1 ) ) );
+                stream->nameLen = 0;
+                stream->length = 0;
+                stream->state = array ? STREAM_VALUE : STREAM_KEY;
+                break;
+            }
+            return streamClose( stream, ch );
+
+        case STREAM_DONE:
+            if ( !isBlank ) return streamError( stream );
+            break;
+
+        default:
+            return JSON_STREAM_ERROR;
+    }
+    return json_streamStatus( stream );
+}
@@ -167,6 +167,74 @@ struct jsonPool_s {
   *         This property is always unnamed and its type is JSON_OBJ. */
 json_t const* json_createWithPool( char* str, jsonPool_t* pool );
 
+
+
+/** Enumeration of codes of the events raised by the stream parser. */
+typedef enum {
+    JSON_BEGIN, JSON_END, JSON_VALUE
+} jsonEvent_t;
+
+/** Enumeration of codes of the states of the stream parser. */
+typedef enum {
+    JSON_STREAM_MORE, JSON_STREAM_DONE, JSON_STREAM_ERROR
+} jsonStreamStatus_t;
+
+/** Callback for the events raised by the stream parser.
+  * @param context The context given to json_streamInit.
+  * @param event JSON_BEGIN when an object or an array opens, JSON_END when
+  *              it closes and JSON_VALUE for any other property.
+  * @param type The type of the property.
+  * @param name Null-terminated name of the property. Null pointer if the
+  *             property is unnamed or the event is JSON_END.
+  * @param value Null-terminated value of the property. Null pointer if the
+  *              event is not JSON_VALUE.
+  * @param depth Number of objects and arrays the property is within.
+  * @note The name and the value are only valid during the call. */
+typedef void (*jsonCallback_t)( void* context, jsonEvent_t event, jsonType_t type,
+                                char const* name, char const* value, unsigned int depth );
+
+/** Maximum nesting of objects and arrays in the stream parser. */
+#define JSON_STREAM_MAX_DEPTH 32
+
+/** Maximum length of a name plus its value in the stream parser. */
+#define JSON_STREAM_TOKEN_LEN 128
+
+/** Structure to handle a stream parser. Its fields are private. */
+typedef struct jsonStream_s {
+    jsonCallback_t callback;
+    void* context;
+    unsigned char state;
+    unsigned char depth;
+    uint32_t arrays;          /**< Bit n is set if the container at depth n is an array. */
+    unsigned int nameLen;     /**< Length of the name in token, with its null. */
+    unsigned int valueStart;  /**< Index of the value in token.  */
+    unsigned int length;      /**< Number of characters in token. */
+    char token[JSON_STREAM_TOKEN_LEN];
+} jsonStream_t;
+
+/** Initialize a stream parser to parse a new JSON object or array.
+  * Unlike json_create the text does not need to be complete before
+  * parsing starts and no json properties are allocated. Each property
+  * is reported through the callback as soon as its last character
+  * has been fed.
+  * @param stream The stream parser.
+  * @param callback Function to call with each event.
+  * @param context Passed to the callback. */
+void json_streamInit( jsonStream_t* stream, jsonCallback_t callback, void* context );
+
+/** Feed the next character to a stream parser.
+  * @param stream The stream parser.
+  * @param ch The character.
+  * @retval JSON_STREAM_MORE If the JSON is not complete yet.
+  * @retval JSON_STREAM_DONE If the root object or array has been closed.
+  * @retval JSON_STREAM_ERROR If any was wrong. It stays in this state. */
+jsonStreamStatus_t json_streamFeed( jsonStream_t* stream, char ch );
+
+/** Get the state of a stream parser.
+  * @param stream The stream parser.
+  * @return The value returned by the last call to json_streamFeed. */
+jsonStreamStatus_t json_streamStatus( jsonStream_t const* stream );
+
 /** @ } */
 
 #ifdef __cplusplus